@@ -0,0 +1,45 @@
+# Compiles bench/compile_time.cpp for several column type counts and records
+# the compile time and object size of each. Run through the
+# compile_time_bench target, or directly:
+#   cmake -DCXX=g++ -DSOURCE_DIR=. -DOUTPUT_DIR=build -P bench/compile_time.cmake
+cmake_minimum_required(VERSION 3.14)
+
+if(NOT DEFINED TYPE_COUNTS)
+    set(TYPE_COUNTS 10 50 200 500)
+endif()
+if(NOT DEFINED FLAGS)
+    set(FLAGS -std=c++17 -O1 -g)
+endif()
+
+# Milliseconds since the epoch; %f needs CMake 3.23, older versions get seconds
+function(now_ms out)
+    string(TIMESTAMP seconds "%s" UTC)
+    if(CMAKE_VERSION VERSION_LESS 3.23)
+        math(EXPR ms "${seconds} * 1000")
+    else()
+        string(TIMESTAMP micros "%f" UTC)
+        math(EXPR ms "${seconds} * 1000 + ${micros} / 1000")
+    endif()
+    set(${out} ${ms} PARENT_SCOPE)
+endfunction()
+
+set(report "types  compile_ms  object_bytes\n")
+foreach(count IN LISTS TYPE_COUNTS)
+    set(object "${OUTPUT_DIR}/compile_time_${count}.o")
+    now_ms(start)
+    execute_process(
+        COMMAND ${CXX} ${FLAGS} -DMULTI_VECTOR_BENCH_TYPES=${count} -I${SOURCE_DIR}
+                -c ${SOURCE_DIR}/bench/compile_time.cpp -o ${object}
+        RESULT_VARIABLE result
+    )
+    now_ms(stop)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "compiling with ${count} types failed")
+    endif()
+    math(EXPR elapsed "${stop} - ${start}")
+    file(SIZE ${object} bytes)
+    string(APPEND report "${count}  ${elapsed}  ${bytes}\n")
+endforeach()
+
+message("${report}")
+file(WRITE "${OUTPUT_DIR}/compile_time.txt" "${report}")
@@ -0,0 +1,47 @@
+// Compile-time benchmark: instantiates multi_vector with
+// MULTI_VECTOR_BENCH_TYPES distinct column types and touches every column
+// through both the type- and the index-based accessors. Built by
+// bench/compile_time.cmake for several type counts.
+#include "multi_vector.hpp"
+
+#include <cstddef>
+#include <utility>
+
+#ifndef MULTI_VECTOR_BENCH_TYPES
+#define MULTI_VECTOR_BENCH_TYPES 10
+#endif
+
+template <std::size_t I>
+struct column {
+    int value;
+};
+
+template <std::size_t... Is>
+multi_vector<column<Is>...> make_table(std::index_sequence<Is...>);
+
+using table = decltype(make_table(std::make_index_sequence<MULTI_VECTOR_BENCH_TYPES>{}));
+
+template <std::size_t... Is>
+table build_table(std::index_sequence<Is...>) {
+    table::builder b;
+    int dummy[] = {(b.capacity<column<Is>>(4), 0)...};
+    (void)dummy;
+    return b.build();
+}
+
+template <std::size_t... Is>
+std::size_t touch(table& t, std::index_sequence<Is...>) {
+    int pushed[] = {(t.push_back(column<Is>{static_cast<int>(Is)}), 0)...};
+    (void)pushed;
+    const std::size_t sizes[] = {(t.size<column<Is>>() + t.capacity<Is>() +
+                                  static_cast<std::size_t>(t.data<Is>()->value))...};
+    std::size_t total = 0;
+    for (std::size_t s : sizes) total += s;
+    return total;
+}
+
+int main() {
+    constexpr auto columns = std::make_index_sequence<MULTI_VECTOR_BENCH_TYPES>{};
+    table t = build_table(columns);
+    return static_cast<int>(touch(t, columns) & 1);
+}
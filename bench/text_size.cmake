@@ -0,0 +1,32 @@
+# Compiles bench/text_size.cpp and records the size of its code, the
+# figure that grows with every multi_vector instantiation. Run through the
+# text_size_bench target, or directly:
+#   cmake -DCXX=g++ -DSOURCE_DIR=. -DOUTPUT_DIR=build -P bench/text_size.cmake
+cmake_minimum_required(VERSION 3.14)
+
+if(NOT DEFINED FLAGS)
+    set(FLAGS -std=c++17 -O2)
+endif()
+if(NOT DEFINED SIZE)
+    find_program(SIZE NAMES size llvm-size REQUIRED)
+endif()
+
+set(object "${OUTPUT_DIR}/text_size.o")
+execute_process(
+    COMMAND ${CXX} ${FLAGS} -I${SOURCE_DIR} -c ${SOURCE_DIR}/bench/text_size.cpp -o ${object}
+    RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "compiling bench/text_size.cpp failed")
+endif()
+
+# Berkeley format: a header line, then text, data, bss, ...
+execute_process(COMMAND ${SIZE} ${object} OUTPUT_VARIABLE sizes RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${SIZE} failed on ${object}")
+endif()
+string(REGEX MATCH "\n[ \t]*([0-9]+)" _ "${sizes}")
+set(report "text_bytes  ${CMAKE_MATCH_1}\n")
+
+message("${report}")
+file(WRITE "${OUTPUT_DIR}/text_size.txt" "${report}")
@@ -0,0 +1,52 @@
+// Code size benchmark: instantiates multi_vector for a set of schemas that
+// mix trivially copyable and non-trivial columns, and runs each through
+// build, push_back, snapshot, shrink_to_fit, move and destruction. Built by
+// bench/text_size.cmake, which reports the size of the code it produces.
+#include "multi_vector.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+template <std::size_t I>
+struct pod {
+    std::uint32_t value;
+};
+
+template <std::size_t I>
+struct text {
+    std::string value;
+};
+
+template <typename... Ts>
+std::size_t exercise() {
+    auto b = typename multi_vector<Ts...>::builder();
+    int caps[] = {(b.template capacity<Ts>(8), 0)...};
+    (void)caps;
+    multi_vector<Ts...> mv = b.build();
+    int pushed[] = {(mv.push_back(Ts{}), 0)...};
+    (void)pushed;
+    auto snap = mv.snapshot();
+    mv.clear();
+    mv.shrink_to_fit();
+    multi_vector<Ts...> moved = std::move(mv);
+    return (moved.template capacity<Ts>() + ...) + (snap.template size<Ts>() + ...);
+}
+
+template <std::size_t S>
+std::size_t schema() {
+    return exercise<pod<S>, pod<S + 100>, text<S>>() +
+           exercise<pod<S>, pod<S + 100>, pod<S + 200>, pod<S + 300>, pod<S + 400>, pod<S + 500>>() +
+           exercise<text<S>, pod<S>, text<S + 100>, pod<S + 100>, text<S + 200>, pod<S + 200>, pod<S + 300>,
+                    pod<S + 400>>();
+}
+
+template <std::size_t... Ss>
+std::size_t all_schemas(std::index_sequence<Ss...>) {
+    return (schema<Ss>() + ...);
+}
+
+int main() {
+    return static_cast<int>(all_schemas(std::make_index_sequence<8>{}) & 1);
+}
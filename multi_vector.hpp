@@ -2,369 +2,4538 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <functional>
 #include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <new>
 #include <optional>
 #include <stdexcept>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
+// C++20 coroutine helpers (batches(), fill_from(), multi_vector_coro::*).
+// Define MULTI_VECTOR_HAS_COROUTINES to 0 to leave them out.
+#ifndef MULTI_VECTOR_HAS_COROUTINES
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L && __has_include(<coroutine>)
+#define MULTI_VECTOR_HAS_COROUTINES 1
+#else
+#define MULTI_VECTOR_HAS_COROUTINES 0
+#endif
+#endif
+
+#if MULTI_VECTOR_HAS_COROUTINES
+#include <coroutine>
+#include <deque>
+#endif
+
+// How many ids ahead gather/scatter prefetch by default
+#ifndef MULTI_VECTOR_PREFETCH_DISTANCE
+#define MULTI_VECTOR_PREFETCH_DISTANCE 16
+#endif
+
+// Tracing hooks for block lifetimes and slow operations. A hook is a type
+// with static members:
+//   static constexpr bool enabled;
+//   static void allocated(const void* block, std::size_t bytes) noexcept;
+//   static void freed(const void* block, std::size_t bytes) noexcept;
+//   static void completed(const char* what, clock::time_point start,
+//                         clock::time_point end, std::size_t bytes) noexcept;
+// Select one by defining MULTI_VECTOR_TRACE_HOOK before including this
+// header, identically in every translation unit. The default, null_hook,
+// compiles to nothing: with `enabled` false not even the clock is read.
+namespace multi_vector_trace {
+
+using clock = std::chrono::steady_clock;
+
+struct null_hook {
+    static constexpr bool enabled = false;
+    static void allocated(const void*, std::size_t) noexcept {}
+    static void freed(const void*, std::size_t) noexcept {}
+    static void completed(const char*, clock::time_point, clock::time_point, std::size_t) noexcept {}
+};
+
+// Writes Chrome trace-event JSON, viewable in chrome://tracing or Perfetto:
+// operations as complete events, allocations and frees as instant events
+// plus a counter of live bytes. Events are dropped until open() succeeds;
+// the file is finished by close() or at exit. The callbacks are noexcept:
+// an event that cannot take the lock is dropped, and write errors are
+// ignored, so tracing never turns into std::terminate.
+class chrome_trace {
+public:
+    static constexpr bool enabled = true;
+
+    static bool open(const char* path) {
+        state& s = get();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        finish(s);
+        s.file = std::fopen(path, "w");
+        if (!s.file) return false;
+        std::fputs("[\n", s.file);
+        s.first = true;
+        return true;
+    }
+
+    static void close() {
+        state& s = get();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        finish(s);
+    }
+
+    static void allocated(const void* block, std::size_t bytes) noexcept {
+        block_event("allocate", block, bytes, static_cast<long long>(bytes));
+    }
+
+    static void freed(const void* block, std::size_t bytes) noexcept {
+        block_event("free", block, bytes, -static_cast<long long>(bytes));
+    }
+
+    static void completed(const char* what, clock::time_point start, clock::time_point end,
+                          std::size_t bytes) noexcept {
+        state& s = get();
+        const std::unique_lock<std::mutex> lock = lock_for_event(s);
+        if (!lock || !s.file) return;
+        separate(s);
+        std::fprintf(s.file,
+                     "{\"name\":\"%s\",\"cat\":\"multi_vector\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                     "\"pid\":1,\"tid\":%zu,\"args\":{\"bytes\":%zu}}",
+                     what, micros(s, start), std::chrono::duration<double, std::micro>(end - start).count(),
+                     thread_number(), bytes);
+    }
+
+private:
+    struct state {
+        std::mutex mutex;
+        std::FILE* file = nullptr;
+        bool first = true;
+        long long live = 0;
+        clock::time_point epoch = clock::now();
+
+        ~state() { finish(*this); }
+    };
+
+    static state& get() {
+        static state s;
+        return s;
+    }
+
+    static void finish(state& s) {
+        if (!s.file) return;
+        std::fputs("\n]\n", s.file);
+        std::fclose(s.file);
+        s.file = nullptr;
+    }
+
+    // std::mutex::lock() may throw std::system_error; an empty lock means
+    // the event is dropped
+    static std::unique_lock<std::mutex> lock_for_event(state& s) noexcept {
+        try {
+            return std::unique_lock<std::mutex>(s.mutex);
+        } catch (...) {
+            return {};
+        }
+    }
+
+    static void separate(state& s) noexcept {
+        if (!s.first) std::fputs(",\n", s.file);
+        s.first = false;
+    }
+
+    static double micros(const state& s, clock::time_point t) noexcept {
+        return std::chrono::duration<double, std::micro>(t - s.epoch).count();
+    }
+
+    static std::size_t thread_number() noexcept {
+        return std::hash<std::thread::id>{}(std::this_thread::get_id()) % 100000;
+    }
+
+    static void block_event(const char* what, const void* block, std::size_t bytes, long long delta) noexcept {
+        state& s = get();
+        const std::unique_lock<std::mutex> lock = lock_for_event(s);
+        if (!lock) return;
+        s.live += delta;
+        if (!s.file) return;
+        const double ts = micros(s, clock::now());
+        separate(s);
+        std::fprintf(s.file,
+                     "{\"name\":\"%s\",\"cat\":\"multi_vector\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,"
+                     "\"pid\":1,\"tid\":%zu,\"args\":{\"block\":\"%p\",\"bytes\":%zu}},\n"
+                     "{\"name\":\"live bytes\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{\"bytes\":%lld}}",
+                     what, ts, thread_number(), block, bytes, ts, s.live);
+    }
+};
+
+} // namespace multi_vector_trace
+
+#ifndef MULTI_VECTOR_TRACE_HOOK
+#define MULTI_VECTOR_TRACE_HOOK multi_vector_trace::null_hook
+#endif
+
+// Non-owning view of contiguous elements, as used by the column kernels.
+template <typename T>
+class column_span {
+    T* data_ = nullptr;
+    std::size_t size_ = 0;
+
+public:
+    column_span() noexcept = default;
+    column_span(T* data, std::size_t size) noexcept : data_(data), size_(size) {}
+
+    template <typename Container,
+              typename = std::enable_if_t<
+                  !std::is_same_v<std::decay_t<Container>, column_span> &&
+                  std::is_convertible_v<decltype(std::declval<Container&>().data()), T*>>>
+    column_span(Container& c) noexcept : data_(c.data()), size_(c.size()) {}
+
+    T* data() const noexcept { return data_; }
+    std::size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+    T* begin() const noexcept { return data_; }
+    T* end() const noexcept { return data_ + size_; }
+    T& operator[](std::size_t i) const noexcept { return data_[i]; }
+};
+
+namespace multi_vector_detail {
+
+// Chase-Lev work-stealing deque, in the C11 formulation of Le et al.
+// (PPoPP 2013). The owning thread pushes and pops at the bottom; any thread
+// may steal from the top. Outgrown rings stay alive until the deque dies,
+// since a thief may still be reading one.
+template <typename T>
+class chase_lev_deque {
+    static_assert(std::is_pointer_v<T>, "chase_lev_deque holds pointers");
+
+    struct ring {
+        explicit ring(std::size_t cap) : mask(cap - 1), slots(new std::atomic<T>[cap]()) {}
+
+        T get(std::int64_t i) const noexcept {
+            return slots[static_cast<std::size_t>(i) & mask].load(std::memory_order_relaxed);
+        }
+
+        void put(std::int64_t i, T v) noexcept {
+            slots[static_cast<std::size_t>(i) & mask].store(v, std::memory_order_relaxed);
+        }
+
+        std::size_t mask;
+        std::unique_ptr<std::atomic<T>[]> slots;
+    };
+
+public:
+    explicit chase_lev_deque(std::size_t capacity = 256) {
+        rings_.push_back(std::make_unique<ring>(capacity));
+        ring_.store(rings_.back().get(), std::memory_order_relaxed);
+    }
+
+    // Owner only
+    void push(T item) {
+        const std::int64_t b = bottom_.load(std::memory_order_relaxed);
+        const std::int64_t t = top_.load(std::memory_order_acquire);
+        ring* r = ring_.load(std::memory_order_relaxed);
+        if (b - t > static_cast<std::int64_t>(r->mask)) {
+            r = grow(r, t, b);
+        }
+        r->put(b, item);
+        bottom_.store(b + 1, std::memory_order_release);
+    }
+
+    // Owner only; nullptr when empty
+    T pop() {
+        const std::int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        ring* r = ring_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t t = top_.load(std::memory_order_relaxed);
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T item = r->get(b);
+        if (t == b) {
+            // Last element: race thieves for it
+            if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                item = nullptr;
+            }
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // Any thread; nullptr when empty or when another thread won the race
+    T steal() {
+        std::int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const std::int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b) return nullptr;
+        T item = ring_.load(std::memory_order_acquire)->get(t);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return item;
+    }
+
+private:
+    ring* grow(ring* old, std::int64_t t, std::int64_t b) {
+        auto bigger = std::make_unique<ring>((old->mask + 1) * 2);
+        for (std::int64_t i = t; i < b; ++i) {
+            bigger->put(i, old->get(i));
+        }
+        ring* r = bigger.get();
+        rings_.push_back(std::move(bigger));
+        ring_.store(r, std::memory_order_release);
+        return r;
+    }
+
+    alignas(64) std::atomic<std::int64_t> top_{0};
+    alignas(64) std::atomic<std::int64_t> bottom_{0};
+    std::atomic<ring*> ring_{nullptr};
+    std::vector<std::unique_ptr<ring>> rings_;
+};
+
+template <typename Tuple, std::size_t... Is>
+void invoke_at(Tuple& fs, std::size_t i, std::index_sequence<Is...>) {
+    ((Is == i ? (void)std::get<Is>(fs)() : void()), ...);
+}
+
+} // namespace multi_vector_detail
+
+// Runs the parallel kernels. Implement bulk() to plug in another thread
+// pool, and install it with set_default_executor().
+class executor {
+public:
+    virtual ~executor() = default;
+
+    // Threads that run work at once, counting the thread that calls bulk()
+    virtual std::size_t concurrency() const noexcept = 0;
+
+    // Calls fn(ctx, i) for every i in [0, n) and returns once all calls are
+    // done, rethrowing the first exception any of them threw.
+    virtual void bulk(std::size_t n, void (*fn)(void*, std::size_t), void* ctx) = 0;
+
+    // Schedules fn(ctx) to run later and returns at once. Exceptions it
+    // throws are dropped. Executors without background threads run it
+    // inline, which is what this default does.
+    virtual void post(void (*fn)(void*), void* ctx) { fn(ctx); }
+};
+
+// Fork/join pool with one Chase-Lev deque per worker. bulk() hands out its
+// index range by recursive halving: a thread keeps the lower half and pushes
+// the upper half on its own deque, where idle workers steal it. Threads
+// outside the pool submit through a locked queue and then help run tasks
+// until their bulk() completes, so nested bulk() calls cannot deadlock.
+// Idle workers sleep on a condition variable.
+class work_stealing_pool final : public executor {
+public:
+    // `threads` counts the caller of bulk(), so threads - 1 workers are
+    // started (0: hardware concurrency)
+    explicit work_stealing_pool(std::size_t threads = 0) {
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        for (std::size_t t = 1; t < threads; ++t) {
+            queues_.push_back(std::make_unique<deque>());
+        }
+        workers_.reserve(queues_.size());
+        for (std::size_t t = 0; t < queues_.size(); ++t) {
+            workers_.emplace_back([this, t] { work(t); });
+        }
+    }
+
+    work_stealing_pool(const work_stealing_pool&) = delete;
+    work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+    // Requires that no bulk() is running. Finishes posted work first.
+    ~work_stealing_pool() override {
+        while (posted_.load(std::memory_order_acquire) != 0) {
+            if (task* t = find_task()) {
+                run(t);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stop_ = true;
+            ++epoch_;
+        }
+        sleep_cv_.notify_all();
+        for (auto& w : workers_) {
+            w.join();
+        }
+    }
+
+    std::size_t concurrency() const noexcept override { return workers_.size() + 1; }
+
+    void bulk(std::size_t n, void (*fn)(void*, std::size_t), void* ctx) override {
+        if (n == 0) return;
+        job j{fn, ctx, n};
+        if (workers_.empty() || n == 1) {
+            for (std::size_t i = 0; i < n; ++i) j.call(i);
+        } else {
+            submit(new task{&j, 0, n});
+            while (j.remaining.load(std::memory_order_acquire) != 0) {
+                if (task* t = find_task()) {
+                    run(t);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+        if (j.error) std::rethrow_exception(j.error);
+    }
+
+    void post(void (*fn)(void*), void* ctx) override {
+        if (workers_.empty()) {
+            fn(ctx);
+            return;
+        }
+        struct posted {
+            void (*fn)(void*);
+            void* ctx;
+        };
+        auto* p = new posted{fn, ctx};
+        auto* j = new job([](void* q, std::size_t) {
+            std::unique_ptr<posted> owned(static_cast<posted*>(q));
+            owned->fn(owned->ctx);
+        }, p, 1);
+        j->detached = true;
+        posted_.fetch_add(1, std::memory_order_relaxed);
+        submit(new task{j, 0, 1});
+    }
+
+private:
+    struct job {
+        void (*fn)(void*, std::size_t);
+        void* ctx;
+        std::atomic<std::size_t> remaining;
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+        // Owned by the pool rather than a waiting bulk() caller
+        bool detached = false;
+
+        job(void (*f)(void*, std::size_t), void* c, std::size_t n) : fn(f), ctx(c), remaining(n) {}
+
+        void call(std::size_t i) noexcept {
+            try {
+                fn(ctx, i);
+            } catch (...) {
+                if (!failed.exchange(true, std::memory_order_relaxed)) error = std::current_exception();
+            }
+        }
+    };
+
+    struct task {
+        job* owner;
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    using deque = multi_vector_detail::chase_lev_deque<task*>;
+
+    struct worker_id {
+        const work_stealing_pool* pool = nullptr;
+        std::size_t index = 0;
+        std::uint64_t seed = 0x9e3779b97f4a7c15ull;
+    };
+
+    static worker_id& current() noexcept {
+        thread_local worker_id id;
+        return id;
+    }
+
+    void submit(task* t) {
+        const worker_id& me = current();
+        if (me.pool == this) {
+            queues_[me.index]->push(t);
+        } else {
+            std::lock_guard<std::mutex> lock(inject_mutex_);
+            injected_.push_back(t);
+            injected_count_.store(injected_.size(), std::memory_order_seq_cst);
+        }
+        // Pairs with the sleeper count increment in work(): either the
+        // sleeper's last look finds this task or we see it and wake it
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers_.load(std::memory_order_relaxed) != 0) {
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex_);
+                ++epoch_;
+            }
+            sleep_cv_.notify_one();
+        }
+    }
+
+    task* find_task() {
+        worker_id& me = current();
+        if (me.pool == this) {
+            if (task* t = queues_[me.index]->pop()) return t;
+        }
+        if (injected_count_.load(std::memory_order_seq_cst) != 0) {
+            std::lock_guard<std::mutex> lock(inject_mutex_);
+            if (!injected_.empty()) {
+                task* t = injected_.back();
+                injected_.pop_back();
+                injected_count_.store(injected_.size(), std::memory_order_relaxed);
+                return t;
+            }
+        }
+        // xorshift64 picks where to start looking for a victim
+        me.seed ^= me.seed << 13;
+        me.seed ^= me.seed >> 7;
+        me.seed ^= me.seed << 17;
+        const std::size_t start = static_cast<std::size_t>(me.seed % queues_.size());
+        for (std::size_t k = 0; k < queues_.size(); ++k) {
+            if (task* t = queues_[(start + k) % queues_.size()]->steal()) return t;
+        }
+        return nullptr;
+    }
+
+    void run(task* t) {
+        job& j = *t->owner;
+        std::size_t begin = t->begin;
+        std::size_t end = t->end;
+        delete t;
+        while (end - begin > 1) {
+            const std::size_t mid = begin + (end - begin) / 2;
+            submit(new task{&j, mid, end});
+            end = mid;
+        }
+        j.call(begin);
+        // A waiting bulk() may return, and free j, as soon as we count down
+        const bool detached = j.detached;
+        if (j.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1 && detached) {
+            delete &j;
+            posted_.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    void work(std::size_t index) {
+        current().pool = this;
+        current().index = index;
+        current().seed += index;
+        for (;;) {
+            if (task* t = find_task()) {
+                run(t);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            if (stop_) return;
+            const std::uint64_t seen = epoch_;
+            sleepers_.fetch_add(1, std::memory_order_seq_cst);
+            lock.unlock();
+            task* t = find_task();
+            lock.lock();
+            if (!t) {
+                sleep_cv_.wait(lock, [&] { return stop_ || epoch_ != seen; });
+            }
+            sleepers_.fetch_sub(1, std::memory_order_relaxed);
+            lock.unlock();
+            if (t) run(t);
+        }
+    }
+
+    std::vector<std::unique_ptr<deque>> queues_;
+    std::vector<std::thread> workers_;
+
+    std::mutex inject_mutex_;
+    std::vector<task*> injected_;
+    std::atomic<std::size_t> injected_count_{0};
+
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_cv_;
+    std::uint64_t epoch_ = 0;
+    bool stop_ = false;
+    std::atomic<std::size_t> sleepers_{0};
+    std::atomic<std::size_t> posted_{0};
+};
+
+namespace multi_vector_detail {
+
+inline std::atomic<executor*>& installed_executor() noexcept {
+    static std::atomic<executor*> installed{nullptr};
+    return installed;
+}
+
+} // namespace multi_vector_detail
+
+// The executor used by the parallel kernels: the one installed with
+// set_default_executor(), else a process-wide work_stealing_pool started on
+// first use.
+inline executor& default_executor() {
+    if (executor* e = multi_vector_detail::installed_executor().load(std::memory_order_acquire)) return *e;
+    static work_stealing_pool pool;
+    return pool;
+}
+
+// Installs `e` (not owned; must outlive its use) as the default executor;
+// nullptr restores the built-in pool.
+inline void set_default_executor(executor* e) noexcept {
+    multi_vector_detail::installed_executor().store(e, std::memory_order_release);
+}
+
+// Splits [begin, end) into chunks of `grain` indices and calls
+// f(chunk_begin, chunk_end) for each, in parallel on `ex`.
+template <typename F>
+void parallel_for(executor& ex, std::size_t begin, std::size_t end, std::size_t grain, F&& f) {
+    if (begin >= end) return;
+    grain = std::max<std::size_t>(grain, 1);
+    struct range {
+        std::remove_reference_t<F>& f;
+        std::size_t begin;
+        std::size_t end;
+        std::size_t grain;
+    } r{f, begin, end, grain};
+    ex.bulk((end - begin + grain - 1) / grain, [](void* p, std::size_t chunk) {
+        auto& r = *static_cast<range*>(p);
+        const std::size_t lo = r.begin + chunk * r.grain;
+        r.f(lo, std::min(r.end, lo + r.grain));
+    }, &r);
+}
+
+template <typename F>
+void parallel_for(std::size_t begin, std::size_t end, std::size_t grain, F&& f) {
+    parallel_for(default_executor(), begin, end, grain, f);
+}
+
+// Runs the callables in parallel on `ex` and returns when all are done
+template <typename... Fs>
+void parallel_invoke(executor& ex, Fs&&... fs) {
+    auto refs = std::forward_as_tuple(fs...);
+    ex.bulk(sizeof...(Fs), [](void* p, std::size_t i) {
+        multi_vector_detail::invoke_at(*static_cast<decltype(refs)*>(p), i, std::index_sequence_for<Fs...>{});
+    }, &refs);
+}
+
+template <typename F, typename... Fs,
+          typename = std::enable_if_t<!std::is_base_of_v<executor, std::decay_t<F>>>>
+void parallel_invoke(F&& f, Fs&&... fs) {
+    parallel_invoke(default_executor(), f, fs...);
+}
+
+namespace multi_vector_detail {
+
+// Per-core data cache size in bytes for level 1 or 2, detected once. Falls
+// back to 32 KiB / 256 KiB when the platform does not report it.
+inline std::size_t cache_size(int level) {
+    static const std::array<std::size_t, 2> sizes = [] {
+        std::size_t l1 = 0;
+        std::size_t l2 = 0;
+#if defined(__linux__) && defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE)
+        const long s1 = ::sysconf(_SC_LEVEL1_DCACHE_SIZE);
+        const long s2 = ::sysconf(_SC_LEVEL2_CACHE_SIZE);
+        l1 = s1 > 0 ? static_cast<std::size_t>(s1) : 0;
+        l2 = s2 > 0 ? static_cast<std::size_t>(s2) : 0;
+#endif
+        return std::array<std::size_t, 2>{l1 ? l1 : 32 * 1024, l2 ? l2 : 256 * 1024};
+    }();
+    return sizes[level <= 1 ? 0 : 1];
+}
+
+inline void prefetch_read(const void* p) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p, 0, 3);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+#else
+    (void)p;
+#endif
+}
+
+inline void prefetch_write(const void* p) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p, 1, 3);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+#else
+    (void)p;
+#endif
+}
+
+// Hardware gather for 4- and 8-byte trivially copyable elements. Handles a
+// prefix of the ids and returns how many it processed; the caller finishes
+// the rest. Lanes index with signed 32-bit offsets, so columns larger than
+// INT32_MAX elements stay on the scalar path.
+template <typename T>
+std::size_t simd_gather(const T* base, std::size_t base_size, const std::uint32_t* ids, std::size_t n,
+                        std::size_t distance, T* out) {
+#if defined(__AVX2__) || defined(__AVX512F__)
+    if constexpr (std::is_trivially_copyable_v<T> && (sizeof(T) == 4 || sizeof(T) == 8)) {
+        if (base_size > 0x7fffffffu) return 0;
+        constexpr std::size_t lanes =
+#if defined(__AVX512F__)
+            64 / sizeof(T);
+#else
+            32 / sizeof(T);
+#endif
+        std::size_t i = 0;
+        for (; i + lanes <= n; i += lanes) {
+            if (i + distance + lanes <= n) {
+                for (std::size_t k = 0; k < lanes; ++k) prefetch_read(base + ids[i + distance + k]);
+            }
+#if defined(__AVX512F__)
+            // Masked forms with a zero source: the unmasked intrinsics start
+            // from an undefined register, which GCC flags as uninitialized
+            if constexpr (sizeof(T) == 4) {
+                const __m512i idx = _mm512_loadu_si512(ids + i);
+                _mm512_storeu_si512(out + i, _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), 0xFFFF, idx, base, 4));
+            } else {
+                const __m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ids + i));
+                _mm512_storeu_si512(out + i, _mm512_mask_i32gather_epi64(_mm512_setzero_si512(), 0xFF, idx, base, 8));
+            }
+#else
+            if constexpr (sizeof(T) == 4) {
+                const __m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ids + i));
+                const __m256i v = _mm256_i32gather_epi32(reinterpret_cast<const int*>(base), idx, 4);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), v);
+            } else {
+                const __m128i idx = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ids + i));
+                const __m256i v = _mm256_i32gather_epi64(reinterpret_cast<const long long*>(base), idx, 8);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), v);
+            }
+#endif
+        }
+        return i;
+    }
+#endif
+    (void)base, (void)base_size, (void)ids, (void)n, (void)distance, (void)out;
+    return 0;
+}
+
+// Software-prefetched gather: while row i is copied, the row `distance` ids
+// ahead is already on its way into cache.
+template <typename T>
+void gather(const T* base, std::size_t base_size, const std::uint32_t* ids, std::size_t n,
+            std::size_t distance, T* out) {
+    std::size_t i = simd_gather(base, base_size, ids, n, distance, out);
+    const std::size_t ahead = n > distance ? n - distance : 0;
+    for (; i < ahead; ++i) {
+        prefetch_read(base + ids[i + distance]);
+        out[i] = base[ids[i]];
+    }
+    for (; i < n; ++i) {
+        out[i] = base[ids[i]];
+    }
+}
+
+template <typename T>
+void scatter(T* base, const std::uint32_t* ids, std::size_t n, std::size_t distance, const T* in) {
+    std::size_t i = 0;
+    const std::size_t ahead = n > distance ? n - distance : 0;
+    for (; i < ahead; ++i) {
+        prefetch_write(base + ids[i + distance]);
+        base[ids[i]] = in[i];
+    }
+    for (; i < n; ++i) {
+        base[ids[i]] = in[i];
+    }
+}
+
+// MurmurHash3 64-bit finalizer. Branch-free and table-free, so hashing loops
+// over arithmetic columns vectorize.
+inline std::uint64_t mix64(std::uint64_t x) noexcept {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+template <typename T>
+constexpr bool is_hashable_v = std::is_arithmetic_v<T> || std::is_enum_v<T> ||
+                               std::is_default_constructible_v<std::hash<T>>;
+
+template <typename T>
+std::uint64_t hash_value(const T& value) {
+    if constexpr (std::is_integral_v<T> || std::is_enum_v<T>) {
+        return mix64(static_cast<std::uint64_t>(value));
+    } else if constexpr (std::is_floating_point_v<T> && (sizeof(T) == 4 || sizeof(T) == 8)) {
+        using bits_t = std::conditional_t<sizeof(T) == 8, std::uint64_t, std::uint32_t>;
+        // +0.0 and -0.0 compare equal, so they must hash equal
+        const T v = value == T(0) ? T(0) : value;
+        bits_t bits;
+        std::memcpy(&bits, &v, sizeof(T));
+        return mix64(bits);
+    } else {
+        return mix64(static_cast<std::uint64_t>(std::hash<T>{}(value)));
+    }
+}
+
+inline int countl_zero64(std::uint64_t x) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+    return x ? __builtin_clzll(x) : 64;
+#else
+    int n = 0;
+    for (std::uint64_t bit = std::uint64_t{1} << 63; bit && !(x & bit); bit >>= 1) ++n;
+    return n;
+#endif
+}
+
+// Hashes are computed a chunk at a time into a local buffer so the hashing
+// loop stays free of the dependent probe/update loads that follow it.
+constexpr std::size_t hash_chunk = 64;
+
+template <typename T, typename F>
+void for_each_hash(const T* ptr, std::size_t n, F&& f) {
+    std::uint64_t hashes[hash_chunk];
+    for (std::size_t base = 0; base < n; base += hash_chunk) {
+        const std::size_t len = std::min(hash_chunk, n - base);
+        for (std::size_t j = 0; j < len; ++j) {
+            hashes[j] = hash_value(ptr[base + j]);
+        }
+        for (std::size_t j = 0; j < len; ++j) {
+            f(base + j, hashes[j]);
+        }
+    }
+}
+
+// Open-addressing set of positions in a column, keyed by the values stored
+// there. Sized once for the whole input, so it never rehashes.
+template <typename T>
+class position_set {
+    struct slot {
+        std::size_t pos;
+        std::uint64_t hash;
+    };
+    static constexpr std::size_t empty = static_cast<std::size_t>(-1);
+
+    const T* values_;
+    std::vector<slot> slots_;
+    std::size_t mask_;
+
+public:
+    position_set(const T* values, std::size_t expected) : values_(values) {
+        std::size_t cap = 16;
+        while (cap < expected * 2) cap <<= 1;
+        slots_.assign(cap, slot{empty, 0});
+        mask_ = cap - 1;
+    }
+
+    // Returns false if a value equal to `value` is already recorded,
+    // otherwise records `pos` (where `value` lives in the column).
+    bool insert(std::size_t pos, const T& value, std::uint64_t hash) {
+        std::size_t i = static_cast<std::size_t>(hash) & mask_;
+        while (slots_[i].pos != empty) {
+            if (slots_[i].hash == hash && values_[slots_[i].pos] == value) return false;
+            i = (i + 1) & mask_;
+        }
+        slots_[i] = slot{pos, hash};
+        return true;
+    }
+};
+
+// Histogram accumulation. Bucket indices for a chunk are computed first in a
+// loop without stores to the counters (so it can vectorize), then counted into
+// `histogram_lanes` private sub-histograms in rotation, so back-to-back hits on
+// one bucket do not serialize on store-to-load forwarding. Index `nbuckets`
+// is a sink for values that fall outside every bucket.
+constexpr std::size_t histogram_lanes = 4;
+constexpr std::size_t bucket_chunk = 256;
+
+template <typename T, typename BucketOf>
+void accumulate_histogram(const T* ptr, std::size_t n, std::size_t nbuckets, const BucketOf& bucket_of,
+                          std::size_t* lanes, std::size_t* out) {
+    const std::size_t stride = nbuckets + 1;
+    std::fill(lanes, lanes + histogram_lanes * stride, std::size_t{0});
+    std::size_t idx[bucket_chunk];
+    for (std::size_t base = 0; base < n; base += bucket_chunk) {
+        const std::size_t len = std::min(bucket_chunk, n - base);
+        for (std::size_t j = 0; j < len; ++j) {
+            idx[j] = bucket_of(ptr[base + j]);
+        }
+        std::size_t j = 0;
+        for (; j + histogram_lanes <= len; j += histogram_lanes) {
+            ++lanes[idx[j]];
+            ++lanes[stride + idx[j + 1]];
+            ++lanes[2 * stride + idx[j + 2]];
+            ++lanes[3 * stride + idx[j + 3]];
+        }
+        for (; j < len; ++j) {
+            ++lanes[idx[j]];
+        }
+    }
+    for (std::size_t b = 0; b < nbuckets; ++b) {
+        out[b] += lanes[b] + lanes[stride + b] + lanes[2 * stride + b] + lanes[3 * stride + b];
+    }
+}
+
+// Runs on `ex`, or the default executor when null; only looked up when the
+// work is actually split.
+template <typename T, typename BucketOf>
+std::vector<std::size_t> histogram(const T* ptr, std::size_t n, std::size_t nbuckets, const BucketOf& bucket_of,
+                                   executor* ex, std::size_t threads) {
+    if (threads == 0) threads = (ex ? *ex : default_executor()).concurrency();
+    threads = std::max<std::size_t>(1, std::min(threads, n / bucket_chunk));
+
+    const std::size_t lane_size = histogram_lanes * (nbuckets + 1);
+    std::vector<std::size_t> lanes(threads * lane_size);
+    std::vector<std::size_t> partial(threads * nbuckets, 0);
+    const std::size_t per_thread = n / threads;
+    auto run = [&](std::size_t t) {
+        const std::size_t begin = t * per_thread;
+        const std::size_t end = t + 1 == threads ? n : begin + per_thread;
+        accumulate_histogram(ptr + begin, end - begin, nbuckets, bucket_of,
+                             lanes.data() + t * lane_size, partial.data() + t * nbuckets);
+    };
+
+    if (threads == 1) {
+        run(0);
+    } else {
+        parallel_for(ex ? *ex : default_executor(), 0, threads, 1, [&](std::size_t lo, std::size_t hi) {
+            for (std::size_t t = lo; t < hi; ++t) run(t);
+        });
+    }
+
+    std::vector<std::size_t> counts(partial.begin(), partial.begin() + nbuckets);
+    for (std::size_t t = 1; t < threads; ++t) {
+        for (std::size_t b = 0; b < nbuckets; ++b) {
+            counts[b] += partial[t * nbuckets + b];
+        }
+    }
+    return counts;
+}
+
+// Maps values to buckets [edges[b], edges[b + 1]); the last bucket is closed.
+template <typename T>
+struct edge_bucket {
+    const std::vector<T>& edges;
+
+    std::size_t operator()(const T& v) const {
+        const std::size_t nbuckets = edges.size() - 1;
+        std::size_t above;
+        if (edges.size() <= 64) {
+            // Branch-free linear scan; cheaper than a binary search for few edges
+            above = 0;
+            for (const T& e : edges) above += !(v < e);
+        } else {
+            above = static_cast<std::size_t>(std::upper_bound(edges.begin(), edges.end(), v) - edges.begin());
+        }
+        if (above == 0) return nbuckets;
+        if (above <= nbuckets) return above - 1;
+        return v == edges.back() ? nbuckets - 1 : nbuckets;
+    }
+};
+
+// Maps values to `nbuckets` equal-width buckets over [lo, hi].
+template <typename T>
+struct fixed_width_bucket {
+    double lo;
+    double hi;
+    double scale;
+    std::size_t nbuckets;
+
+    std::size_t operator()(const T& v) const {
+        const double x = static_cast<double>(v);
+        // NaN fails both comparisons and lands in the sink
+        if (!(lo <= x && x <= hi)) return nbuckets;
+        // Rounding can push values just below hi to nbuckets
+        return std::min(static_cast<std::size_t>((x - lo) * scale), nbuckets - 1);
+    }
+};
+
+// Lazy column expressions. Nodes hold pointers and operands by value and are
+// evaluated element-wise in a single loop, so `a * b + c` never materializes a
+// temporary column. A scalar operand broadcasts to every row.
+constexpr std::size_t broadcast_size = static_cast<std::size_t>(-1);
+
+template <typename Derived>
+struct column_expr;
+
+template <typename E>
+constexpr bool is_column_expr_v = std::is_base_of_v<column_expr<E>, E>;
+
+template <typename Derived>
+struct column_expr {
+    const Derived& self() const { return static_cast<const Derived&>(*this); }
+
+    // Writes size() results to `out`, which must not overlap the operands
+    // except at the same row.
+    template <typename Out>
+    void eval_into(Out* out) const {
+        const Derived& e = self();
+        const std::size_t n = e.size();
+        for (std::size_t i = 0; i < n; ++i) {
+            out[i] = static_cast<Out>(e[i]);
+        }
+    }
+
+    template <typename T, typename Op>
+    T reduce(T init, Op op) const {
+        const Derived& e = self();
+        const std::size_t n = e.size();
+        for (std::size_t i = 0; i < n; ++i) {
+            init = op(init, e[i]);
+        }
+        return init;
+    }
+
+    // Four independent partial sums let the compiler vectorize the loop even
+    // for floating-point values, at the cost of summing in a different order.
+    auto sum() const {
+        const Derived& e = self();
+        using value_type = std::decay_t<decltype(e[0])>;
+        const std::size_t n = e.size();
+        value_type acc[4] = {value_type{}, value_type{}, value_type{}, value_type{}};
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            acc[0] += e[i];
+            acc[1] += e[i + 1];
+            acc[2] += e[i + 2];
+            acc[3] += e[i + 3];
+        }
+        for (; i < n; ++i) {
+            acc[0] += e[i];
+        }
+        return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+    }
+};
+
+template <typename T>
+struct column_ref : column_expr<column_ref<T>> {
+    const T* ptr;
+    std::size_t n;
+
+    column_ref(const T* p, std::size_t count) : ptr(p), n(count) {}
+    std::size_t size() const { return n; }
+    const T& operator[](std::size_t i) const { return ptr[i]; }
+};
+
+template <typename T>
+struct scalar_ref : column_expr<scalar_ref<T>> {
+    T value;
+
+    explicit scalar_ref(T v) : value(v) {}
+    std::size_t size() const { return broadcast_size; }
+    const T& operator[](std::size_t) const { return value; }
+};
+
+template <typename Op, typename E>
+struct unary_expr : column_expr<unary_expr<Op, E>> {
+    E operand;
+
+    explicit unary_expr(const E& e) : operand(e) {}
+    std::size_t size() const { return operand.size(); }
+    auto operator[](std::size_t i) const { return Op{}(operand[i]); }
+};
+
+template <typename Op, typename L, typename R>
+struct binary_expr : column_expr<binary_expr<Op, L, R>> {
+    L lhs;
+    R rhs;
+    std::size_t n;
+
+    binary_expr(const L& l, const R& r) : lhs(l), rhs(r) {
+        const std::size_t ln = l.size();
+        const std::size_t rn = r.size();
+        if (ln != rn && ln != broadcast_size && rn != broadcast_size) {
+            throw std::invalid_argument("multi_vector column expression operands differ in size");
+        }
+        n = ln == broadcast_size ? rn : ln;
+    }
+    std::size_t size() const { return n; }
+    auto operator[](std::size_t i) const { return Op{}(lhs[i], rhs[i]); }
+};
+
+template <typename T>
+auto as_expr(const T& operand) {
+    if constexpr (is_column_expr_v<T>) {
+        return operand;
+    } else {
+        return scalar_ref<T>(operand);
+    }
+}
+
+template <typename L, typename R>
+constexpr bool expr_operands_v = (is_column_expr_v<L> && (is_column_expr_v<R> || std::is_arithmetic_v<R>)) ||
+                                 (std::is_arithmetic_v<L> && is_column_expr_v<R>);
+
+template <typename Op, typename L, typename R>
+auto make_binary(const L& l, const R& r) {
+    auto le = as_expr(l);
+    auto re = as_expr(r);
+    return binary_expr<Op, decltype(le), decltype(re)>(le, re);
+}
+
+template <typename L, typename R, std::enable_if_t<expr_operands_v<L, R>, int> = 0>
+auto operator+(const L& l, const R& r) { return make_binary<std::plus<>>(l, r); }
+
+template <typename L, typename R, std::enable_if_t<expr_operands_v<L, R>, int> = 0>
+auto operator-(const L& l, const R& r) { return make_binary<std::minus<>>(l, r); }
+
+template <typename L, typename R, std::enable_if_t<expr_operands_v<L, R>, int> = 0>
+auto operator*(const L& l, const R& r) { return make_binary<std::multiplies<>>(l, r); }
+
+template <typename L, typename R, std::enable_if_t<expr_operands_v<L, R>, int> = 0>
+auto operator/(const L& l, const R& r) { return make_binary<std::divides<>>(l, r); }
+
+template <typename E, std::enable_if_t<is_column_expr_v<E>, int> = 0>
+auto operator-(const E& e) { return unary_expr<std::negate<>, E>(e); }
+
+// Range handling for arithmetic conversions. in_range() and saturate() are
+// branch-free selects so the checking and clamping loops vectorize.
+// Floating-point values convert to integers by truncation toward zero.
+template <typename Src, typename Dst>
+struct conversion {
+    static_assert(std::is_arithmetic_v<Src> && std::is_arithmetic_v<Dst>,
+                  "checked and saturating conversions require arithmetic types");
+
+    static constexpr Dst dst_min = std::numeric_limits<Dst>::lowest();
+    static constexpr Dst dst_max = std::numeric_limits<Dst>::max();
+
+    static bool in_range(Src v) {
+        if constexpr (std::is_floating_point_v<Dst>) {
+            if constexpr (std::is_integral_v<Src> || sizeof(Dst) >= sizeof(Src)) {
+                return true;
+            } else {
+                // NaN and infinities convert to their narrower counterparts
+                return !(v < static_cast<Src>(dst_min) || v > static_cast<Src>(dst_max)) ||
+                       std::isinf(v);
+            }
+        } else if constexpr (std::is_floating_point_v<Src>) {
+            return v - static_cast<Src>(dst_min) > Src(-1) && v < float_high;
+        } else if constexpr (std::is_signed_v<Src>) {
+            return v < 0 ? std::is_signed_v<Dst> && static_cast<std::intmax_t>(v) >= static_cast<std::intmax_t>(dst_min)
+                         : static_cast<std::uintmax_t>(v) <= static_cast<std::uintmax_t>(dst_max);
+        } else {
+            return static_cast<std::uintmax_t>(v) <= static_cast<std::uintmax_t>(dst_max);
+        }
+    }
+
+    static Dst saturate(Src v) {
+        if constexpr (std::is_floating_point_v<Dst>) {
+            if constexpr (std::is_integral_v<Src> || sizeof(Dst) >= sizeof(Src)) {
+                return static_cast<Dst>(v);
+            } else {
+                // Finite values clamp; infinities pass through, matching
+                // checked mode, and NaN stays NaN
+                if (std::isinf(v)) return static_cast<Dst>(v);
+                const Src lo = static_cast<Src>(dst_min);
+                const Src hi = static_cast<Src>(dst_max);
+                return static_cast<Dst>(v < lo ? lo : (v > hi ? hi : v));
+            }
+        } else if constexpr (std::is_floating_point_v<Src>) {
+            if (v != v) return Dst{0};
+            return !(v - static_cast<Src>(dst_min) > Src(-1)) ? dst_min
+                                                             : (v >= float_high ? dst_max : static_cast<Dst>(v));
+        } else {
+            if (in_range(v)) return static_cast<Dst>(v);
+            if constexpr (std::is_signed_v<Src>) {
+                if (v < 0) return dst_min;
+            }
+            return dst_max;
+        }
+    }
+
+private:
+    static constexpr Src pow2(int e) {
+        Src r = 1;
+        for (int k = 0; k < e; ++k) r *= 2;
+        return r;
+    }
+
+    // Exclusive upper bound for float-to-integer conversion, exact in Src.
+    // The lower bound is tested as `v - min > -1`, which is exact near min
+    // and accepts values that truncate onto it.
+    static constexpr Src float_high = pow2(std::is_floating_point_v<Src> ? std::numeric_limits<Dst>::digits : 0);
+};
+
+// Reports the lifetime of a scope to the trace hook as one completed
+// operation; does nothing, not even read the clock, for disabled hooks.
+template <typename Hook>
+class trace_span {
+    const char* what_;
+    std::size_t bytes_;
+    multi_vector_trace::clock::time_point start_{};
+
+public:
+    trace_span(const char* what, std::size_t bytes) noexcept : what_(what), bytes_(bytes) {
+        if constexpr (Hook::enabled) start_ = multi_vector_trace::clock::now();
+    }
+
+    trace_span(const trace_span&) = delete;
+    trace_span& operator=(const trace_span&) = delete;
+
+    ~trace_span() {
+        if constexpr (Hook::enabled) Hook::completed(what_, start_, multi_vector_trace::clock::now(), bytes_);
+    }
+};
+
+// Never-reused ids, so thread-local caches keyed by instance cannot be fooled
+// by a new instance at a freed address.
+inline std::uint64_t next_instance_id() noexcept {
+    static std::atomic<std::uint64_t> next{1};
+    return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Per-thread shard choice for atomic_counter: threads are numbered round
+// robin on first use, which spreads them evenly over the shards.
+inline std::size_t counter_shard_seed() noexcept {
+    static std::atomic<std::size_t> next{0};
+    thread_local const std::size_t mine = next.fetch_add(1, std::memory_order_relaxed);
+    return mine;
+}
+
+// Process-wide registry of reader records for rcu_multi_vector. Each thread
+// owns one record whose counter is odd while it is inside a read section;
+// the owner only ever stores to it, so entering and leaving a section costs
+// a thread-local increment and a fence but no read-modify-write. Records are
+// recycled when threads exit and never freed.
+class rcu_domain {
+public:
+    struct alignas(64) reader {
+        std::atomic<std::uint64_t> counter{0};
+        std::atomic<bool> in_use{true};
+        reader* next = nullptr;
+        unsigned depth = 0;  // nesting, touched by the owner only
+    };
+
+    // A reader that was inside a read section when a grace period began
+    struct waiting_reader {
+        reader* rec;
+        std::uint64_t counter;
+    };
+
+    static rcu_domain& instance() {
+        // Leaked on purpose: thread_local records may be released after
+        // static destructors have run
+        static rcu_domain* domain = new rcu_domain;
+        return *domain;
+    }
+
+    reader& local() {
+        struct handle {
+            reader* rec;
+            explicit handle(rcu_domain& d) : rec(d.acquire_record()) {}
+            ~handle() { rec->in_use.store(false, std::memory_order_release); }
+        };
+        thread_local handle h(*this);
+        return *h.rec;
+    }
+
+    void enter(reader& r) noexcept {
+        if (r.depth++ == 0) {
+            r.counter.store(r.counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            // Pairs with the fence in readers_inside(): either the writer sees
+            // this odd counter, or this thread sees the newly published pointer
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    void leave(reader& r) noexcept {
+        if (--r.depth == 0) {
+            r.counter.store(r.counter.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+    }
+
+    // Records the readers currently inside a read section. Call after
+    // unpublishing a pointer; once all of them have moved on, no reader can
+    // still hold it.
+    std::vector<waiting_reader> readers_inside() const {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::vector<waiting_reader> inside;
+        for (reader* r = head_.load(std::memory_order_acquire); r; r = r->next) {
+            const std::uint64_t c = r->counter.load(std::memory_order_acquire);
+            if (c & 1u) inside.push_back(waiting_reader{r, c});
+        }
+        return inside;
+    }
+
+    // Drops readers that have left the section they were in; true once none remain.
+    static bool grace_period_over(std::vector<waiting_reader>& waiting) {
+        waiting.erase(std::remove_if(waiting.begin(), waiting.end(),
+                                     [](const waiting_reader& w) {
+                                         return w.rec->counter.load(std::memory_order_acquire) != w.counter;
+                                     }),
+                      waiting.end());
+        return waiting.empty();
+    }
+
+private:
+    reader* acquire_record() {
+        for (reader* r = head_.load(std::memory_order_acquire); r; r = r->next) {
+            bool expected = false;
+            if (!r->in_use.load(std::memory_order_relaxed) &&
+                r->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                return r;
+            }
+        }
+        reader* r = new reader;
+        r->next = head_.load(std::memory_order_relaxed);
+        while (!head_.compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+        return r;
+    }
+
+    std::atomic<reader*> head_{nullptr};
+};
+
+} // namespace multi_vector_detail
+
+#if MULTI_VECTOR_HAS_COROUTINES
+namespace multi_vector_coro {
+
+// Lazily produced sequence of values, consumed with range-for.
+template <typename T>
+class generator {
+public:
+    struct promise_type {
+        std::optional<T> value;
+        std::exception_ptr error;
+
+        generator get_return_object() { return generator(handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(T v) {
+            value = std::move(v);
+            return {};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    using handle = std::coroutine_handle<promise_type>;
+
+    class iterator {
+        handle h_;
+
+        void resume() {
+            h_.resume();
+            if (h_.promise().error) std::rethrow_exception(h_.promise().error);
+        }
+
+    public:
+        explicit iterator(handle h) : h_(h) { resume(); }
+        const T& operator*() const { return *h_.promise().value; }
+        iterator& operator++() {
+            resume();
+            return *this;
+        }
+        bool operator==(std::default_sentinel_t) const { return h_.done(); }
+    };
+
+    explicit generator(handle h) : h_(h) {}
+    generator(generator&& other) noexcept : h_(std::exchange(other.h_, {})) {}
+    generator& operator=(generator&&) = delete;
+    ~generator() {
+        if (h_) h_.destroy();
+    }
+
+    iterator begin() { return iterator(h_); }
+    std::default_sentinel_t end() const noexcept { return {}; }
+
+private:
+    handle h_;
+};
+
+// Lazily started coroutine producing one value of type T. Awaiting it runs
+// the body and resumes the awaiter when it finishes.
+template <typename T>
+class task {
+public:
+    struct promise_type {
+        std::optional<T> value;
+        std::exception_ptr error;
+        std::coroutine_handle<> continuation;
+
+        struct final_awaiter {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                const auto next = h.promise().continuation;
+                return next ? next : std::noop_coroutine();
+            }
+            void await_resume() const noexcept {}
+        };
+
+        task get_return_object() { return task(handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        final_awaiter final_suspend() noexcept { return {}; }
+        void return_value(T v) { value = std::move(v); }
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    using handle = std::coroutine_handle<promise_type>;
+
+    explicit task(handle h) : h_(h) {}
+    task(task&& other) noexcept : h_(std::exchange(other.h_, {})) {}
+    task& operator=(task&&) = delete;
+    ~task() {
+        if (h_) h_.destroy();
+    }
+
+    auto operator co_await() && noexcept {
+        struct awaiter {
+            handle h;
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                h.promise().continuation = awaiting;
+                return h;
+            }
+            T await_resume() {
+                if (h.promise().error) std::rethrow_exception(h.promise().error);
+                return std::move(*h.promise().value);
+            }
+        };
+        return awaiter{h_};
+    }
+
+private:
+    handle h_;
+};
+
+namespace detail {
+
+// Fire-and-forget coroutine whose frame frees itself on completion.
+struct detached {
+    struct promise_type {
+        detached get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+} // namespace detail
+
+// Runs `t` and blocks the calling thread until it completes, which may
+// happen on another thread if the task suspends on something resumed there.
+template <typename T>
+T sync_wait(task<T> t) {
+    std::mutex m;
+    std::condition_variable cv;
+    bool done = false;
+    std::optional<T> result;
+    std::exception_ptr error;
+
+    auto run = [&]() -> detail::detached {
+        try {
+            result.emplace(co_await std::move(t));
+        } catch (...) {
+            error = std::current_exception();
+        }
+        // Notify under the lock: the waiter may destroy cv as soon as it can
+        // observe `done`
+        std::lock_guard<std::mutex> lock(m);
+        done = true;
+        cv.notify_one();
+    };
+    run();
+
+    std::unique_lock<std::mutex> lock(m);
+    cv.wait(lock, [&] { return done; });
+    if (error) std::rethrow_exception(error);
+    return std::move(*result);
+}
+
+template <typename... Ts>
+class batch_pool;
+
+} // namespace multi_vector_coro
+#endif
+
+enum class conversion_mode {
+    unchecked,  // plain static_cast; out-of-range float-to-integer is undefined
+    checked,    // throw std::range_error, leaving the destination untouched
+    saturating, // clamp to the destination range, NaN becomes 0
+};
+
+// Identifies a column's element type at run time without RTTI: the address
+// of a per-type tag, equal for equal types within one program.
+using column_type_id = const void*;
+
+namespace multi_vector_detail {
+
+template <typename T>
+struct type_tag {
+    static constexpr char tag = 0;
+};
+
+} // namespace multi_vector_detail
+
+template <typename T>
+constexpr column_type_id column_type_id_of() noexcept {
+    return &multi_vector_detail::type_tag<std::remove_cv_t<T>>::tag;
+}
+
+// Type-erased description of one column, so serializers, checksums and other
+// byte-oriented tools can be compiled once for every schema. Elements
+// [0, size) at data are live; a wrapped circular column is in storage order
+// until linearize() is called. Only trivially copyable columns may be read
+// as raw bytes.
+struct column_desc {
+    const void* data;
+    std::size_t element_size;
+    std::size_t alignment;
+    std::size_t size;
+    std::size_t capacity;
+    bool trivially_copyable;
+    column_type_id type;
+
+    std::size_t bytes() const noexcept { return size * element_size; }
+
+    template <typename T>
+    bool holds() const noexcept {
+        return type == column_type_id_of<T>();
+    }
+
+    // The elements as T; T must be the column's type
+    template <typename T>
+    column_span<const T> as() const noexcept {
+        return {static_cast<const T*>(data), size};
+    }
+};
+
+namespace multi_vector_detail {
+
+// The per-type half of a column_desc, fixed for each column of a schema
+struct column_traits {
+    std::size_t element_size;
+    std::size_t alignment;
+    bool trivially_copyable;
+    column_type_id type;
+};
+
+template <typename T>
+constexpr column_traits column_traits_of() noexcept {
+    return {sizeof(T), alignof(T), std::is_trivially_copyable_v<T>, column_type_id_of<T>()};
+}
+
+} // namespace multi_vector_detail
+
+// Every column of an instance as column_desc values, in column order. A
+// view: it is invalidated by anything that moves or reallocates columns.
+class column_descs {
+    const void* const* data_ = nullptr;
+    const std::size_t* sizes_ = nullptr;
+    const std::size_t* capacities_ = nullptr;
+    const multi_vector_detail::column_traits* traits_ = nullptr;
+    std::size_t count_ = 0;
+
+public:
+    class iterator;
+
+    column_descs() noexcept = default;
+    column_descs(const void* const* data, const std::size_t* sizes, const std::size_t* capacities,
+                 const multi_vector_detail::column_traits* traits, std::size_t count) noexcept
+        : data_(data), sizes_(sizes), capacities_(capacities), traits_(traits), count_(count) {}
+
+    std::size_t size() const noexcept { return count_; }
+    bool empty() const noexcept { return count_ == 0; }
+
+    column_desc operator[](std::size_t i) const noexcept {
+        const multi_vector_detail::column_traits& t = traits_[i];
+        return {data_[i], t.element_size, t.alignment, sizes_[i], capacities_[i], t.trivially_copyable, t.type};
+    }
+
+    // As operator[], but throws std::out_of_range unless i < size()
+    column_desc at(std::size_t i) const {
+        if (i >= count_) throw std::out_of_range("multi_vector column index out of range");
+        return (*this)[i];
+    }
+
+    iterator begin() const noexcept;
+    iterator end() const noexcept;
+};
+
+class column_descs::iterator {
+    column_descs range_;
+    std::size_t i_ = 0;
+
+public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = column_desc;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = column_desc;
+
+    iterator() noexcept = default;
+    iterator(const column_descs& range, std::size_t i) noexcept : range_(range), i_(i) {}
+
+    column_desc operator*() const noexcept { return range_[i_]; }
+    column_desc operator[](difference_type n) const noexcept { return range_[i_ + n]; }
+
+    iterator& operator++() noexcept { ++i_; return *this; }
+    iterator operator++(int) noexcept { iterator old = *this; ++i_; return old; }
+    iterator& operator--() noexcept { --i_; return *this; }
+    iterator operator--(int) noexcept { iterator old = *this; --i_; return old; }
+    iterator& operator+=(difference_type n) noexcept { i_ += n; return *this; }
+    iterator& operator-=(difference_type n) noexcept { i_ -= n; return *this; }
+    iterator operator+(difference_type n) const noexcept { return {range_, i_ + n}; }
+    friend iterator operator+(difference_type n, const iterator& it) noexcept { return it + n; }
+    iterator operator-(difference_type n) const noexcept { return {range_, i_ - n}; }
+    difference_type operator-(const iterator& other) const noexcept {
+        return static_cast<difference_type>(i_) - static_cast<difference_type>(other.i_);
+    }
+
+    bool operator==(const iterator& other) const noexcept { return i_ == other.i_; }
+    bool operator!=(const iterator& other) const noexcept { return i_ != other.i_; }
+    bool operator<(const iterator& other) const noexcept { return i_ < other.i_; }
+    bool operator>(const iterator& other) const noexcept { return i_ > other.i_; }
+    bool operator<=(const iterator& other) const noexcept { return i_ <= other.i_; }
+    bool operator>=(const iterator& other) const noexcept { return i_ >= other.i_; }
+};
+
+inline column_descs::iterator column_descs::begin() const noexcept {
+    return {*this, 0};
+}
+
+inline column_descs::iterator column_descs::end() const noexcept {
+    return {*this, count_};
+}
+
+struct no_op_counters;
+
+template <typename Policy, typename... Ts>
+class basic_multi_vector;
+
+template <typename... Ts>
+using multi_vector = basic_multi_vector<no_op_counters, Ts...>;
+
+// Frees memory on a background thread so that releasing multi-GB blocks
+// does not stall the thread that drops them. Instances built with
+// reclaim_with() destroy their elements as usual and then hand the raw
+// block over; whole instances can be retired too. At most `max_pending`
+// items wait at a time: past that, retire() frees on the calling thread
+// rather than letting unreclaimed memory pile up. Must outlive every
+// instance that uses it.
+class block_reclaimer {
+public:
+    explicit block_reclaimer(std::size_t max_pending = 64)
+        : slots_(std::max<std::size_t>(1, max_pending)), thread_([this] { reclaim(); }) {}
+
+    block_reclaimer(const block_reclaimer&) = delete;
+    block_reclaimer& operator=(const block_reclaimer&) = delete;
+
+    ~block_reclaimer() {
+        flush();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        work_cv_.notify_one();
+        thread_.join();
+    }
+
+    // Takes ownership of `p`; release(p) runs on the reclaimer thread, or
+    // right here when the queue is full.
+    void retire(void (*release)(void*), void* p) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (queued_ < slots_.size()) {
+                slots_[(head_ + queued_) % slots_.size()] = item{release, p};
+                ++queued_;
+                ++pending_;
+                lock.unlock();
+                work_cv_.notify_one();
+                return;
+            }
+            ++inline_;
+        }
+        release(p);
+    }
+
+    // Destroys and frees a whole instance in the background
+    template <typename Policy, typename... Ts>
+    void retire(basic_multi_vector<Policy, Ts...>&& mv) {
+        using vector_type = basic_multi_vector<Policy, Ts...>;
+        auto* doomed = new vector_type(std::move(mv));
+        retire([](void* p) { delete static_cast<vector_type*>(p); }, doomed);
+    }
+
+    // Waits until everything retired so far has been freed
+    void flush() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_cv_.wait(lock, [&] { return pending_ == 0; });
+    }
+
+    std::size_t pending() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pending_;
+    }
+
+    // Items freed on the retiring thread because the queue was full
+    std::size_t freed_inline() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return inline_;
+    }
+
+private:
+    struct item {
+        void (*release)(void*) = nullptr;
+        void* p = nullptr;
+    };
+
+    void reclaim() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            work_cv_.wait(lock, [&] { return stop_ || queued_ > 0; });
+            if (queued_ == 0) return;
+            const item next = slots_[head_];
+            head_ = (head_ + 1) % slots_.size();
+            --queued_;
+            lock.unlock();
+            next.release(next.p);
+            lock.lock();
+            if (--pending_ == 0) idle_cv_.notify_all();
+        }
+    }
+
+    mutable std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable idle_cv_;
+    // Fixed ring, so retiring never allocates
+    std::vector<item> slots_;
+    std::size_t head_ = 0;
+    std::size_t queued_ = 0;
+    // Queued plus being freed
+    std::size_t pending_ = 0;
+    std::size_t inline_ = 0;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+// Byte budget shared by a group of instances (or the whole process, when
+// every builder gets the same one). build() and copy-on-write column copies
+// draw from it and freeing returns to it. A request that does not fit calls
+// the pressure handler, which may free memory elsewhere, e.g. by calling
+// shrink_to_fit() or dropping cold instances, and returns true to retry;
+// without a handler, or when it returns false, the request fails fast with
+// std::bad_alloc. The handler may run on any allocating thread, and must
+// outlive every instance drawing from the budget. A request made from
+// inside the handler on the same thread (say, by a shrink_to_fit() that
+// still needs memory) fails with std::bad_alloc instead of re-entering it.
+class memory_budget {
+public:
+    using pressure_handler = std::function<bool(memory_budget&, std::size_t requested)>;
+
+    explicit memory_budget(std::size_t limit, pressure_handler on_pressure = {})
+        : limit_(limit), on_pressure_(std::move(on_pressure)) {}
+
+    memory_budget(const memory_budget&) = delete;
+    memory_budget& operator=(const memory_budget&) = delete;
+
+    bool try_acquire(std::size_t bytes) noexcept {
+        std::size_t used = usage_.load(std::memory_order_relaxed);
+        do {
+            if (bytes > limit_.load(std::memory_order_relaxed) - std::min(used, limit_.load(std::memory_order_relaxed))) {
+                return false;
+            }
+        } while (!usage_.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed));
+        std::size_t peak = peak_.load(std::memory_order_relaxed);
+        while (used + bytes > peak && !peak_.compare_exchange_weak(peak, used + bytes, std::memory_order_relaxed)) {
+        }
+        return true;
+    }
+
+    void acquire(std::size_t bytes) {
+        while (!try_acquire(bytes)) {
+            if (!on_pressure_ || in_handler()) throw std::bad_alloc();
+            handler_scope scope(this);
+            if (!on_pressure_(*this, bytes)) throw std::bad_alloc();
+        }
+    }
+
+    void release(std::size_t bytes) noexcept {
+        usage_.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    std::size_t usage() const noexcept { return usage_.load(std::memory_order_relaxed); }
+    std::size_t peak() const noexcept { return peak_.load(std::memory_order_relaxed); }
+    std::size_t limit() const noexcept { return limit_.load(std::memory_order_relaxed); }
+
+    // Lowering the limit below usage() only affects later requests
+    void set_limit(std::size_t limit) noexcept { limit_.store(limit, std::memory_order_relaxed); }
+
+private:
+    // The budgets whose handler is running on this thread, innermost first
+    struct handler_scope {
+        const memory_budget* budget;
+        handler_scope* outer;
+
+        explicit handler_scope(const memory_budget* b) noexcept : budget(b), outer(top()) { top() = this; }
+        ~handler_scope() { top() = outer; }
+        handler_scope(const handler_scope&) = delete;
+        handler_scope& operator=(const handler_scope&) = delete;
+
+        static handler_scope*& top() noexcept {
+            static thread_local handler_scope* scope = nullptr;
+            return scope;
+        }
+    };
+
+    bool in_handler() const noexcept {
+        for (const handler_scope* s = handler_scope::top(); s; s = s->outer) {
+            if (s->budget == this) return true;
+        }
+        return false;
+    }
+
+    std::atomic<std::size_t> limit_;
+    std::atomic<std::size_t> usage_{0};
+    std::atomic<std::size_t> peak_{0};
+    pressure_handler on_pressure_;
+};
+
+// Counter element for columns updated from many threads. Each element
+// occupies whole cache lines so neighbouring counters never false-share.
+// With Shards > 1 an element holds that many cache-line slots; each thread
+// adds to its own slot and reads sum them, trading read cost and memory for
+// uncontended increments on very hot counters.
+template <typename T, std::size_t Shards = 1>
+class atomic_counter {
+    static_assert(std::is_integral_v<T>, "atomic_counter requires an integral type");
+    static_assert(Shards > 0, "atomic_counter needs at least one shard");
+
+    struct alignas(64) slot {
+        std::atomic<T> value{};
+    };
+    slot slots_[Shards];
+
+public:
+    using value_type = T;
+    static constexpr std::size_t shards = Shards;
+
+    atomic_counter(T initial = T{}) noexcept {
+        slots_[0].value.store(initial, std::memory_order_relaxed);
+    }
+
+    // Copies snapshot the aggregated value, so counters can be pushed and
+    // used as builder defaults
+    atomic_counter(const atomic_counter& other) noexcept : atomic_counter(other.load()) {}
+
+    atomic_counter& operator=(const atomic_counter& other) noexcept {
+        store(other.load());
+        return *this;
+    }
+
+    // Returns the previous value of the slot that was updated, which is the
+    // counter's previous value only when Shards == 1
+    T fetch_add(T v, std::memory_order order = std::memory_order_relaxed) noexcept {
+        return slots_[Shards == 1 ? 0 : multi_vector_detail::counter_shard_seed() % Shards].value.fetch_add(v, order);
+    }
+
+    T load(std::memory_order order = std::memory_order_relaxed) const noexcept {
+        T total = slots_[0].value.load(order);
+        for (std::size_t s = 1; s < Shards; ++s) {
+            total += slots_[s].value.load(order);
+        }
+        return total;
+    }
+
+    // Not atomic with respect to concurrent fetch_add when sharded
+    void store(T v, std::memory_order order = std::memory_order_relaxed) noexcept {
+        slots_[0].value.store(v, order);
+        for (std::size_t s = 1; s < Shards; ++s) {
+            slots_[s].value.store(T{}, order);
+        }
+    }
+};
+
+namespace multi_vector_detail {
+
+template <typename T>
+struct is_atomic_counter : std::false_type {};
+
+template <typename T, std::size_t Shards>
+struct is_atomic_counter<atomic_counter<T, Shards>> : std::true_type {};
+
+// Type pack lookup in one instantiation per pack rather than one per
+// element: the pack becomes a single class with one base per (index, type)
+// pair, and overload resolution against it finds either half of a pair.
+template <std::size_t I, typename T>
+struct pack_slot {
+    using type = T;
+};
+
+template <typename Indices, typename... Ts>
+struct pack_slots;
+
+template <std::size_t... Is, typename... Ts>
+struct pack_slots<std::index_sequence<Is...>, Ts...> : pack_slot<Is, Ts>... {};
+
+template <std::size_t I, typename T>
+pack_slot<I, T> slot_at(const pack_slot<I, T>&);
+
+template <typename T, std::size_t I>
+constexpr std::size_t slot_of(const pack_slot<I, T>*) noexcept {
+    return I;
+}
+
+// Missing types, and types listed twice, which make the base ambiguous
+template <typename T>
+constexpr std::size_t slot_of(const void*) noexcept {
+    return static_cast<std::size_t>(-1);
+}
+
+template <typename T, typename... Ts>
+constexpr std::size_t first_index_of() noexcept {
+    constexpr bool matches[] = {std::is_same_v<T, Ts>...};
+    for (std::size_t i = 0; i < sizeof...(Ts); ++i) {
+        if (matches[i]) return i;
+    }
+    return sizeof...(Ts);
+}
+
+// Index of the first T in Ts, or sizeof...(Ts) if there is none
+template <typename T, typename... Ts>
+constexpr std::size_t index_of() noexcept {
+    constexpr std::size_t i =
+        slot_of<T>(static_cast<const pack_slots<std::index_sequence_for<Ts...>, Ts...>*>(nullptr));
+    if constexpr (i != static_cast<std::size_t>(-1)) {
+        return i;
+    } else {
+        return first_index_of<T, Ts...>();
+    }
+}
+
+template <std::size_t I, typename... Ts>
+using type_at = typename decltype(slot_at<I>(std::declval<pack_slots<std::index_sequence_for<Ts...>, Ts...>>()))::type;
+
+// Per-column optional values, flat like pack_slots. A std::tuple nests one
+// base per element, each naming the rest of the pack, which is quadratic
+// in symbols and debug info.
+template <std::size_t I, typename T>
+struct optional_slot {
+    std::optional<T> value;
+};
+
+template <typename Indices, typename... Ts>
+struct optional_slots;
+
+template <std::size_t... Is, typename... Ts>
+struct optional_slots<std::index_sequence<Is...>, Ts...> : optional_slot<Is, Ts>... {};
+
+} // namespace multi_vector_detail
+
+// Instrumentation policies, the first template argument of
+// basic_multi_vector. no_op_counters, the default, adds no state and no
+// code. op_counters keeps per-instance counts of pushes and capacity
+// failures per column, reallocations (shrink_to_fit and copy-on-write
+// copies) with the bytes they copied, and each column's peak size, all read
+// through stats(). With Atomic the counts are relaxed atomics, so stats()
+// may be read while another thread writes.
+struct no_op_counters {};
+
+template <bool Atomic = false>
+struct op_counters {};
+
+template <std::size_t N>
+struct op_stats {
+    std::array<std::size_t, N> pushes{};
+    std::array<std::size_t, N> failures{};
+    std::array<std::size_t, N> peak_sizes{};
+    std::size_t reallocations = 0;
+    std::size_t bytes_moved = 0;
+};
+
+namespace multi_vector_detail {
+
+template <typename Policy, std::size_t N>
+class op_recorder {
+protected:
+    void note_push(std::size_t, std::size_t) noexcept {}
+    void note_failure(std::size_t) noexcept {}
+    void note_size(std::size_t, std::size_t) noexcept {}
+    void note_reallocation(std::size_t) noexcept {}
+
+public:
+    static constexpr bool counting = false;
+
+    op_stats<N> stats() const noexcept { return {}; }
+};
+
+template <bool Atomic, std::size_t N>
+class op_recorder<op_counters<Atomic>, N> {
+    using count = std::conditional_t<Atomic, std::atomic<std::size_t>, std::size_t>;
+
+    count pushes_[N]{};
+    count failures_[N]{};
+    count peaks_[N]{};
+    count reallocations_{};
+    count bytes_moved_{};
+
+    static std::size_t get(const count& c) noexcept {
+        if constexpr (Atomic) {
+            return c.load(std::memory_order_relaxed);
+        } else {
+            return c;
+        }
+    }
+
+    static void add(count& c, std::size_t v) noexcept {
+        if constexpr (Atomic) {
+            c.fetch_add(v, std::memory_order_relaxed);
+        } else {
+            c += v;
+        }
+    }
+
+    static void raise(count& c, std::size_t v) noexcept {
+        if constexpr (Atomic) {
+            std::size_t seen = c.load(std::memory_order_relaxed);
+            while (seen < v && !c.compare_exchange_weak(seen, v, std::memory_order_relaxed)) {}
+        } else {
+            if (c < v) c = v;
+        }
+    }
+
+    static void set(count& c, std::size_t v) noexcept {
+        if constexpr (Atomic) {
+            c.store(v, std::memory_order_relaxed);
+        } else {
+            c = v;
+        }
+    }
+
+protected:
+    op_recorder() noexcept = default;
+
+    op_recorder(const op_recorder& other) noexcept {
+        for (std::size_t i = 0; i < N; ++i) {
+            set(pushes_[i], get(other.pushes_[i]));
+            set(failures_[i], get(other.failures_[i]));
+            set(peaks_[i], get(other.peaks_[i]));
+        }
+        set(reallocations_, get(other.reallocations_));
+        set(bytes_moved_, get(other.bytes_moved_));
+    }
+
+    void note_push(std::size_t i, std::size_t size) noexcept {
+        add(pushes_[i], 1);
+        raise(peaks_[i], size);
+    }
+
+    void note_failure(std::size_t i) noexcept { add(failures_[i], 1); }
+    void note_size(std::size_t i, std::size_t size) noexcept { raise(peaks_[i], size); }
+
+    void note_reallocation(std::size_t bytes) noexcept {
+        add(reallocations_, 1);
+        add(bytes_moved_, bytes);
+    }
+
+public:
+    static constexpr bool counting = true;
+
+    op_stats<N> stats() const noexcept {
+        op_stats<N> s;
+        for (std::size_t i = 0; i < N; ++i) {
+            s.pushes[i] = get(pushes_[i]);
+            s.failures[i] = get(failures_[i]);
+            s.peak_sizes[i] = get(peaks_[i]);
+        }
+        s.reallocations = get(reallocations_);
+        s.bytes_moved = get(bytes_moved_);
+        return s;
+    }
+};
+
+// Reference-counted memory shared between an instance and its snapshots.
+// refs[i] counts the holders of column i that live in this memory (the
+// original block holds every column, a column detached by a write holds
+// one); total counts all of them and frees the memory at zero. While a
+// column has several holders its contents are immutable, so all holders
+// agree on its size.
+struct shared_storage {
+    std::unique_ptr<std::atomic<std::size_t>[]> refs;
+    std::atomic<std::size_t> total{0};
+    void* memory = nullptr;
+    memory_budget* budget = nullptr;
+    // Frees the memory in the background when set, like an unshared block
+    block_reclaimer* reclaimer = nullptr;
+    std::size_t bytes = 0;
+    std::size_t align = 0;
+
+    explicit shared_storage(std::size_t columns) : refs(new std::atomic<std::size_t>[columns]()) {}
+};
+
+// The type-independent half of basic_multi_vector: the block, its memory
+// accounting and every loop over the per-column arrays. The typed layer owns
+// those arrays and passes them in as a column_table, so this code is emitted
+// once for all schemas instead of once per instantiation.
+class multi_vector_base {
+protected:
+    using trace_hook = MULTI_VECTOR_TRACE_HOOK;
+
+    // The typed layer's per-column arrays, `count` entries each
+    struct column_table {
+        std::size_t count;
+        void** data;
+        std::size_t* sizes;
+        std::size_t* capacities;
+        shared_storage** storage;
+        std::size_t* heads;
+        bool* circular;
+    };
+
+    multi_vector_base() noexcept = default;
+
+    multi_vector_base(multi_vector_base&& other) noexcept
+        : block_(std::exchange(other.block_, nullptr)), block_size_(std::exchange(other.block_size_, 0)),
+          destroy_threads_(other.destroy_threads_), reclaimer_(other.reclaimer_), budget_(other.budget_) {}
+
+    ~multi_vector_base() = default;
+
+    // Offsets of columns laid out back to back in order, each aligned for
+    // its type; returns the block size.
+    static std::size_t plan_layout(std::size_t count, const std::size_t* caps, const std::size_t* type_sizes,
+                                   const std::size_t* type_aligns, std::size_t* offsets) noexcept {
+        std::size_t off = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            const std::size_t a = type_aligns[i];
+            off = a ? (off + (a - 1)) & ~(a - 1) : off;
+            offsets[i] = off;
+            off += caps[i] * type_sizes[i];
+        }
+        return off;
+    }
+
+    // Allocates `bytes` charged to `budget`, which may be null
+    static void* allocate_charged(std::size_t bytes, std::size_t align, memory_budget* budget) {
+        if (budget) budget->acquire(bytes);
+        void* memory = nullptr;
+        try {
+            memory = ::operator new(bytes, std::align_val_t{align});
+        } catch (...) {
+            if (budget) budget->release(bytes);
+            throw;
+        }
+        trace_hook::allocated(memory, bytes);
+        return memory;
+    }
+
+    static void free_charged(void* memory, std::size_t bytes, std::size_t align, memory_budget* budget) noexcept {
+        trace_hook::freed(memory, bytes);
+        ::operator delete(memory, std::align_val_t{align});
+        if (budget) budget->release(bytes);
+    }
+
+    void allocate_block(std::size_t bytes, std::size_t align, memory_budget* budget) {
+        block_ = allocate_charged(bytes, align, budget);
+        block_size_ = bytes;
+        budget_ = budget;
+    }
+
+    // Frees the block, on the reclaimer's thread if there is one. `free_fn`
+    // must match the block's alignment.
+    void release_block(void (*free_fn)(void*)) noexcept {
+        trace_hook::freed(block_, block_size_);
+        if (reclaimer_) {
+            reclaimer_->retire(free_fn, block_);
+        } else {
+            free_fn(block_);
+        }
+        if (budget_) budget_->release(block_size_);
+    }
+
+    static void place_columns(column_table t, void* block, const std::size_t* offsets, const std::size_t* caps,
+                              const bool* circular) noexcept {
+        for (std::size_t i = 0; i < t.count; ++i) {
+            t.data[i] = static_cast<void*>(static_cast<std::byte*>(block) + offsets[i]);
+            t.capacities[i] = caps[i];
+            t.circular[i] = circular[i];
+        }
+    }
+
+    // Move construction: `dst` takes the columns and `src` is left empty
+    static void take_columns(column_table dst, column_table src) noexcept {
+        for (std::size_t i = 0; i < dst.count; ++i) {
+            dst.data[i] = std::exchange(src.data[i], nullptr);
+            dst.sizes[i] = std::exchange(src.sizes[i], 0);
+            dst.capacities[i] = std::exchange(src.capacities[i], 0);
+            dst.storage[i] = std::exchange(src.storage[i], nullptr);
+            dst.heads[i] = std::exchange(src.heads[i], 0);
+            dst.circular[i] = src.circular[i];
+        }
+    }
+
+    void swap_contents(multi_vector_base& other, column_table mine, column_table theirs) noexcept {
+        for (std::size_t i = 0; i < mine.count; ++i) {
+            std::swap(mine.data[i], theirs.data[i]);
+            std::swap(mine.sizes[i], theirs.sizes[i]);
+            std::swap(mine.capacities[i], theirs.capacities[i]);
+            std::swap(mine.storage[i], theirs.storage[i]);
+            std::swap(mine.heads[i], theirs.heads[i]);
+            std::swap(mine.circular[i], theirs.circular[i]);
+        }
+        std::swap(block_, other.block_);
+        std::swap(block_size_, other.block_size_);
+        std::swap(destroy_threads_, other.destroy_threads_);
+        std::swap(reclaimer_, other.reclaimer_);
+        std::swap(budget_, other.budget_);
+    }
+
+    bool holds_memory(column_table t) const noexcept {
+        return block_ || std::any_of(t.storage, t.storage + t.count, [](const shared_storage* s) { return s; });
+    }
+
+    static bool is_tight(column_table t) noexcept {
+        return std::equal(t.sizes, t.sizes + t.count, t.capacities);
+    }
+
+    static std::size_t bytes_in_use(column_table t, const std::size_t* type_sizes) noexcept {
+        std::size_t bytes = 0;
+        for (std::size_t i = 0; i < t.count; ++i) bytes += t.sizes[i] * type_sizes[i];
+        return bytes;
+    }
+
+    // Column i of a trivially copyable type, copied bytewise
+    static void copy_trivial_column(column_table dst, column_table src, std::size_t i, std::size_t type_size) noexcept {
+        if (src.sizes[i]) std::memcpy(dst.data[i], src.data[i], src.sizes[i] * type_size);
+        dst.sizes[i] = src.sizes[i];
+    }
+
+    // Moves the block under reference counting so snapshots can share it.
+    void share_block(column_table t, std::size_t align) {
+        if (!block_) return;
+        auto* s = new shared_storage(t.count);
+        for (std::size_t i = 0; i < t.count; ++i) {
+            s->refs[i].store(1, std::memory_order_relaxed);
+            t.storage[i] = s;
+        }
+        s->total.store(t.count, std::memory_order_relaxed);
+        s->memory = block_;
+        s->budget = budget_;
+        s->reclaimer = reclaimer_;
+        s->bytes = block_size_;
+        s->align = align;
+        block_ = nullptr;
+    }
+
+    // Storage holding only column i, for a column detached by a write
+    static shared_storage* column_storage(std::size_t count, std::size_t i, void* memory, std::size_t bytes,
+                                          std::size_t align, memory_budget* budget, block_reclaimer* reclaimer) {
+        auto* s = new shared_storage(count);
+        s->refs[i].store(1, std::memory_order_relaxed);
+        s->total.store(1, std::memory_order_relaxed);
+        s->memory = memory;
+        s->budget = budget;
+        s->reclaimer = reclaimer;
+        s->bytes = bytes;
+        s->align = align;
+        return s;
+    }
+
+    // Adds a holder for every shared column of `count` to the `out` arrays
+    static void share_columns(std::size_t count, shared_storage* const* storage, void* const* data,
+                              const std::size_t* sizes, shared_storage** out_storage, void** out_data,
+                              std::size_t* out_sizes) noexcept {
+        for (std::size_t i = 0; i < count; ++i) {
+            out_storage[i] = storage[i];
+            out_data[i] = data[i];
+            out_sizes[i] = sizes[i];
+            if (storage[i]) {
+                storage[i]->refs[i].fetch_add(1, std::memory_order_relaxed);
+                storage[i]->total.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Drops one holder of column i; true for the last one, which must then
+    // destroy the elements before calling drop_storage()
+    static bool drop_column(shared_storage* s, std::size_t i) noexcept {
+        return s->refs[i].fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    // The last holder frees the memory, through the reclaimer if there is
+    // one, and returns it to the budget at once as release_block() does
+    static void drop_storage(shared_storage* s) noexcept {
+        if (s->total.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        trace_hook::freed(s->memory, s->bytes);
+        if (s->budget) s->budget->release(s->bytes);
+        if (s->reclaimer) {
+            s->reclaimer->retire(&free_storage, s);
+        } else {
+            free_storage(s);
+        }
+    }
+
+    static void free_storage(void* p) noexcept {
+        auto* s = static_cast<shared_storage*>(p);
+        ::operator delete(s->memory, std::align_val_t{s->align});
+        delete s;
+    }
+
+    void* block_ = nullptr;
+    std::size_t block_size_ = 0;
+    // Threads destroying each large column; 1 is serial, 0 all of them
+    std::size_t destroy_threads_ = 1;
+    block_reclaimer* reclaimer_ = nullptr;
+    memory_budget* budget_ = nullptr;
+};
+
+} // namespace multi_vector_detail
+
+template <typename Policy, typename... Ts>
+class basic_multi_vector : multi_vector_detail::multi_vector_base,
+                           public multi_vector_detail::op_recorder<Policy, sizeof...(Ts)> {
+
+    static_assert(sizeof...(Ts) > 0, "multi_vector requires at least one type");
+
+    static constexpr std::size_t N = sizeof...(Ts);
+
+    template <typename T>
+    static constexpr std::size_t idx_v = multi_vector_detail::index_of<T, Ts...>();
+
+    // Whether T is one of the column types; one lookup, not a fold over Ts
+    template <typename T>
+    static constexpr bool has_v = idx_v<T> < N;
+
+    template <std::size_t I>
+    using type_at = multi_vector_detail::type_at<I, Ts...>;
+
+    using base = multi_vector_detail::multi_vector_base;
+    using recorder = multi_vector_detail::op_recorder<Policy, N>;
+    using shared_storage = multi_vector_detail::shared_storage;
+
+    static constexpr std::array<std::size_t, N> type_sizes_{sizeof(Ts)...};
+    static constexpr multi_vector_detail::column_traits column_traits_[N]{
+        multi_vector_detail::column_traits_of<Ts>()...};
+    static constexpr std::array<std::size_t, N> type_aligns_{alignof(Ts)...};
+    static constexpr std::size_t block_align_ = std::max({alignof(Ts)...});
+
+    template <std::size_t... Is>
+    void destroy_elements(std::index_sequence<Is...>) {
+        (destroy_elements_at<Is>(), ...);
+    }
+
+    template <std::size_t... Is>
+    void clear_columns(std::index_sequence<Is...>) {
+        (clear<Is>(), ...);
+    }
+
+    static void free_block(void* block) noexcept {
+        ::operator delete(block, std::align_val_t{block_align_});
+    }
+
+    column_table table() noexcept {
+        return {N, data_ptrs_, sizes_, capacities_, storage_, heads_, circular_};
+    }
+
+    // Columns shorter than this are destroyed serially even when
+    // parallel_destroy() was requested
+    static constexpr std::size_t parallel_destroy_min = std::size_t{1} << 15;
+
+    template <std::size_t I>
+    void destroy_elements_at() {
+        using T = type_at<I>;
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            T* ptr = static_cast<T*>(data_ptrs_[I]);
+            const std::size_t n = sizes_[I];
+            if (destroy_threads_ != 1 && n >= parallel_destroy_min) {
+                // This runs from the noexcept destructor, and starting the
+                // default pool or bulk() may throw. Chunks are claimed before
+                // they are destroyed, so on failure this thread destroys the
+                // ones nobody claimed instead of terminating.
+                constexpr std::size_t max_chunks = 64;
+                std::atomic<bool> claimed[max_chunks] = {};
+                std::size_t grain = (n + max_chunks - 1) / max_chunks;
+                const auto destroy_chunk = [&](std::size_t lo) {
+                    if (claimed[lo / grain].exchange(true, std::memory_order_relaxed)) return;
+                    const std::size_t hi = std::min(n, lo + grain);
+                    for (std::size_t j = lo; j < hi; ++j) {
+                        ptr[j].~T();
+                    }
+                };
+                try {
+                    executor& ex = default_executor();
+                    const std::size_t threads = std::clamp<std::size_t>(
+                        destroy_threads_ ? destroy_threads_ : ex.concurrency(), 1, max_chunks);
+                    grain = (n + threads - 1) / threads;
+                    parallel_for(ex, 0, n, grain, [&](std::size_t lo, std::size_t) { destroy_chunk(lo); });
+                } catch (...) {
+                    for (std::size_t lo = 0; lo < n; lo += grain) destroy_chunk(lo);
+                }
+                return;
+            }
+            for (std::size_t j = 0; j < n; ++j) {
+                ptr[j].~T();
+            }
+        }
+    }
+
+    template <std::size_t I>
+    static void destroy_range(void* data, std::size_t n) noexcept {
+        using T = type_at<I>;
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            T* ptr = static_cast<T*>(data);
+            for (std::size_t j = 0; j < n; ++j) {
+                ptr[j].~T();
+            }
+        }
+    }
+
+    // Drops one holder of column I; the last holder destroys the elements.
+    template <std::size_t I>
+    static void release_column(shared_storage* s, void* data, std::size_t n) noexcept {
+        if (drop_column(s, I)) destroy_range<I>(data, n);
+        drop_storage(s);
+    }
+
+    template <std::size_t... Is>
+    static void release_columns(shared_storage* const* storage, void* const* data, const std::size_t* sizes,
+                                std::index_sequence<Is...>) noexcept {
+        ((storage[Is] ? release_column<Is>(storage[Is], data[Is], sizes[Is]) : void()), ...);
+    }
+
+    template <std::size_t I>
+    bool column_shared() const noexcept {
+        return storage_[I] && storage_[I]->refs[I].load(std::memory_order_acquire) > 1;
+    }
+
+    // Copy-on-write: before column I is modified, give this instance its own
+    // copy if a snapshot still holds the current one. With `keep` false the
+    // new column starts empty instead of copying the elements.
+    template <std::size_t I>
+    void make_column_unique(bool keep = true) {
+        if (column_shared<I>()) detach_column<I>(keep);
+    }
+
+    template <std::size_t... Is>
+    void make_columns_unique(std::index_sequence<Is...>) {
+        (make_column_unique<Is>(), ...);
+    }
+
+    template <std::size_t I>
+    void detach_column(bool keep) {
+        using T = type_at<I>;
+        if constexpr (!std::is_copy_constructible_v<T>) {
+            if (keep) throw std::logic_error("multi_vector cannot copy a shared column of a non-copyable type");
+        }
+        const std::size_t bytes = capacities_[I] * sizeof(T);
+        multi_vector_detail::trace_span<trace_hook> span("multi_vector::copy_column", bytes);
+        void* memory = allocate_charged(bytes, block_align_, budget_);
+        std::size_t copied = 0;
+        shared_storage* s = nullptr;
+        try {
+            if constexpr (std::is_copy_constructible_v<T>) {
+                if (keep) {
+                    const T* src = static_cast<const T*>(data_ptrs_[I]);
+                    T* dst = static_cast<T*>(memory);
+                    if constexpr (std::is_trivially_copyable_v<T>) {
+                        copied = sizes_[I];
+                        if (copied) std::memcpy(static_cast<void*>(dst), src, copied * sizeof(T));
+                    } else {
+                        for (; copied < sizes_[I]; ++copied) {
+                            ::new (static_cast<void*>(dst + copied)) T(src[copied]);
+                        }
+                    }
+                }
+            }
+            s = column_storage(N, I, memory, bytes, block_align_, budget_, reclaimer_);
+        } catch (...) {
+            destroy_range<I>(memory, copied);
+            free_charged(memory, bytes, block_align_, budget_);
+            throw;
+        }
+        this->note_reallocation(copied * sizeof(T));
+        release_column<I>(storage_[I], data_ptrs_[I], sizes_[I]);
+        storage_[I] = s;
+        data_ptrs_[I] = memory;
+        sizes_[I] = copied;
+    }
+
+    template <std::size_t... Is>
+    void move_columns_into(basic_multi_vector& dst, std::index_sequence<Is...>) {
+        (move_column_into<Is>(dst), ...);
+    }
+
+    template <std::size_t I>
+    void move_column_into(basic_multi_vector& dst) {
+        using T = type_at<I>;
+        linearize<I>();
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            copy_trivial_column(dst.table(), table(), I, sizeof(T));
+            return;
+        }
+        T* out = static_cast<T*>(dst.data_ptrs_[I]);
+        if constexpr (std::is_copy_constructible_v<T>) {
+            // Snapshots keep a shared column alive; copying beats detaching it
+            if (column_shared<I>()) {
+                const T* src = static_cast<const T*>(data_ptrs_[I]);
+                for (std::size_t j = 0; j < sizes_[I]; ++j) {
+                    ::new (static_cast<void*>(out + j)) T(src[j]);
+                    dst.sizes_[I] = j + 1;
+                }
+                return;
+            }
+        }
+        T* src = data<I>();
+        for (std::size_t j = 0; j < sizes_[I]; ++j) {
+            ::new (static_cast<void*>(out + j)) T(std::move_if_noexcept(src[j]));
+            dst.sizes_[I] = j + 1;
+        }
+    }
+
+    template <std::size_t I>
+    void overwrite_oldest(const type_at<I>& value) {
+        using T = type_at<I>;
+        T* slot = data<I>() + heads_[I];
+        if constexpr (std::is_copy_assignable_v<T>) {
+            *slot = value;
+        } else {
+            // Copy first so a throwing copy leaves the old element in place
+            T copy(value);
+            slot->~T();
+            ::new (static_cast<void*>(slot)) T(std::move(copy));
+        }
+        heads_[I] = heads_[I] + 1 == capacities_[I] ? 0 : heads_[I] + 1;
+    }
+
+    // Makes column I hold exactly `n` elements, the j-th being T(gen(j)).
+    // Live elements are assigned, missing ones constructed and surplus ones
+    // destroyed. Throws std::length_error if `n` exceeds the capacity.
+    template <std::size_t I, typename Gen>
+    void overwrite_column(std::size_t n, const Gen& gen) {
+        using T = type_at<I>;
+        if (n > capacities_[I]) {
+            this->note_failure(I);
+            throw std::length_error("multi_vector capacity exceeded for this type");
+        }
+        this->note_size(I, n);
+        make_column_unique<I>();
+        T* ptr = static_cast<T*>(data_ptrs_[I]);
+        if constexpr (std::is_trivially_copyable_v<T> && std::is_trivially_default_constructible_v<T>) {
+            // No per-element bookkeeping, so the loop can vectorize
+            for (std::size_t j = 0; j < n; ++j) {
+                ptr[j] = static_cast<T>(gen(j));
+            }
+            sizes_[I] = n;
+            return;
+        }
+        const std::size_t old = sizes_[I];
+        const std::size_t live = std::min(n, old);
+        for (std::size_t j = 0; j < live; ++j) {
+            ptr[j] = static_cast<T>(gen(j));
+        }
+        for (std::size_t j = live; j < n; ++j) {
+            ::new (static_cast<void*>(ptr + j)) T(gen(j));
+            sizes_[I] = j + 1;
+        }
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            for (std::size_t j = n; j < old; ++j) {
+                ptr[j].~T();
+            }
+        }
+        sizes_[I] = n;
+        heads_[I] = 0;
+    }
+
+    // Shared by histogram() and parallel_histogram(); a null `ex` means the
+    // default executor
+    template <std::size_t idx>
+    std::vector<std::size_t> histogram_on(const std::vector<type_at<idx>>& bucket_edges, executor* ex,
+                                          std::size_t threads) const {
+        using T = type_at<idx>;
+        if (bucket_edges.size() < 2 || !std::is_sorted(bucket_edges.begin(), bucket_edges.end())) {
+            throw std::invalid_argument("multi_vector histogram needs at least two sorted bucket edges");
+        }
+        return multi_vector_detail::histogram(data<idx>(), sizes_[idx], bucket_edges.size() - 1,
+                                              multi_vector_detail::edge_bucket<T>{bucket_edges}, ex, threads);
+    }
+
+    template <std::size_t idx>
+    std::vector<std::size_t> histogram_on(type_at<idx> min, type_at<idx> max, std::size_t nbuckets, executor* ex,
+                                          std::size_t threads) const {
+        using T = type_at<idx>;
+        static_assert(std::is_arithmetic_v<T>, "fixed-width histogram requires an arithmetic type");
+        if (!(min < max) || nbuckets == 0) {
+            throw std::invalid_argument("multi_vector histogram needs min < max and at least one bucket");
+        }
+        const double lo = static_cast<double>(min);
+        const double hi = static_cast<double>(max);
+        const multi_vector_detail::fixed_width_bucket<T> bucket_of{
+            lo, hi, static_cast<double>(nbuckets) / (hi - lo), nbuckets};
+        return multi_vector_detail::histogram(data<idx>(), sizes_[idx], nbuckets, bucket_of, ex, threads);
+    }
+
+    template <typename... Us, typename Self, typename F, std::size_t... Is>
+    static void for_each_batch_impl(Self& self, std::size_t batch_rows, F& f, std::index_sequence<Is...>) {
+        if (batch_rows == 0) batch_rows = default_batch_rows();
+        const std::size_t rows = std::max({self.sizes_[Is]...});
+        for (std::size_t start = 0; start < rows; start += batch_rows) {
+            f(column_span<Us>(static_cast<Us*>(self.data_ptrs_[Is]) + (start < self.sizes_[Is] ? start : 0),
+                              start < self.sizes_[Is] ? std::min(batch_rows, self.sizes_[Is] - start) : 0)...);
+        }
+    }
+
+#if MULTI_VECTOR_HAS_COROUTINES
+    template <std::size_t... Is>
+    std::tuple<column_span<Ts>...> batch_at(std::size_t start, std::size_t batch_rows, std::index_sequence<Is...>) {
+        make_columns_unique(std::index_sequence<Is...>{});
+        return {column_span<Ts>(static_cast<Ts*>(data_ptrs_[Is]) + (start < sizes_[Is] ? start : 0),
+                                start < sizes_[Is] ? std::min(batch_rows, sizes_[Is] - start) : 0)...};
+    }
+#endif
+
+    void* data_ptrs_[N]{};
+    std::size_t sizes_[N]{};
+    std::size_t capacities_[N]{};
+    // Set per column once snapshots share its memory; block_ is then null
+    shared_storage* storage_[N]{};
+    // Circular columns: storage index of the oldest element once wrapped
+    std::size_t heads_[N]{};
+    bool circular_[N]{};
+
+    friend struct builder;
+
+    template <typename, typename...>
+    friend class basic_multi_vector;
+
+    template <typename... Us>
+    friend class append_only_multi_vector;
+
+    template <typename... Us>
+    friend class sharded_multi_vector;
+
+public:
+    // Schema introspection for wrappers and generic code
+    static constexpr std::size_t column_count = N;
+
+    template <typename T>
+    static constexpr std::size_t column_index = idx_v<T>;
+
+    template <std::size_t I>
+    using column_type = type_at<I>;
+
+    basic_multi_vector() noexcept = default;
+
+    ~basic_multi_vector() {
+        // Empty and moved-from instances have nothing to trace
+        if (!holds_memory(table())) return;
+        multi_vector_detail::trace_span<trace_hook> span("multi_vector::destroy", block_size_);
+        release_columns(storage_, data_ptrs_, sizes_, std::make_index_sequence<N>{});
+        if (!block_) return;
+        destroy_elements(std::make_index_sequence<N>{});
+        release_block(&free_block);
+    }
+
+    basic_multi_vector(basic_multi_vector&& other) noexcept : base(std::move(other)), recorder(other) {
+        take_columns(table(), other.table());
+    }
+
+    // Hands the contents to `ex` to destroy and free in the background,
+    // leaving this instance empty with no capacity. Use it to keep the
+    // teardown of huge non-trivial columns off a latency-sensitive thread.
+    void destroy_async(executor& ex = default_executor()) {
+        if (!holds_memory(table())) return;
+        auto* doomed = new basic_multi_vector(std::move(*this));
+        ex.post([](void* p) { delete static_cast<basic_multi_vector*>(p); }, doomed);
+    }
+
+    // Reallocates with every capacity equal to its size, returning the
+    // difference to the memory budget. Circular columns are linearized
+    // first. Elements are moved when that cannot throw, copied otherwise.
+    // An unshared block is never charged twice, so this may be called from
+    // the budget's pressure handler; with snapshots alive the old memory
+    // stays in use and the new block is charged in full.
+    void shrink_to_fit() {
+        if (is_tight(table())) return;
+        multi_vector_detail::trace_span<trace_hook> span("multi_vector::shrink_to_fit", block_size_);
+        builder b;
+        for (std::size_t i = 0; i < N; ++i) {
+            b.caps_[i] = sizes_[i];
+            b.circular_[i] = circular_[i];
+        }
+        b.destroy_threads_ = destroy_threads_;
+        b.reclaimer_ = reclaimer_;
+        // The new block is smaller than the one it replaces, which stays
+        // charged until the swap and then only gives back the difference
+        const bool replaces_block = block_ != nullptr;
+        b.budget_ = replaces_block ? nullptr : budget_;
+        basic_multi_vector fresh = b.build();
+        move_columns_into(fresh, std::make_index_sequence<N>{});
+        swap_contents(fresh, table(), fresh.table());
+        if (replaces_block) {
+            budget_ = std::exchange(fresh.budget_, nullptr);
+            if (budget_) budget_->release(fresh.block_size_ - block_size_);
+        }
+        this->note_reallocation(bytes_in_use(table(), type_sizes_.data()));
+    }
+
+    // Immutable point-in-time view that shares column storage with the
+    // instance it was taken from. Copies are cheap; the storage lives as long
+    // as any holder does, and a snapshot may outlive the instance and be used
+    // or released on another thread.
+    class snapshot_type {
+        shared_storage* storage_[N]{};
+        void* data_ptrs_[N]{};
+        std::size_t sizes_[N]{};
+
+        friend class basic_multi_vector;
+
+    public:
+        snapshot_type() noexcept = default;
+
+        snapshot_type(const snapshot_type& other) noexcept {
+            share_columns(N, other.storage_, other.data_ptrs_, other.sizes_, storage_, data_ptrs_, sizes_);
+        }
+
+        snapshot_type(snapshot_type&& other) noexcept {
+            swap(other);
+        }
+
+        snapshot_type& operator=(snapshot_type other) noexcept {
+            swap(other);
+            return *this;
+        }
+
+        ~snapshot_type() {
+            release_columns(storage_, data_ptrs_, sizes_, std::make_index_sequence<N>{});
+        }
+
+        void swap(snapshot_type& other) noexcept {
+            for (std::size_t i = 0; i < N; ++i) {
+                std::swap(storage_[i], other.storage_[i]);
+                std::swap(data_ptrs_[i], other.data_ptrs_[i]);
+                std::swap(sizes_[i], other.sizes_[i]);
+            }
+        }
+
+        template <typename T>
+        std::size_t size() const noexcept {
+            static_assert(has_v<T>, "T must be in multi_vector");
+            return sizes_[idx_v<T>];
+        }
+
+        template <std::size_t idx>
+        std::size_t size() const noexcept {
+            static_assert(idx < N, "Index out of bounds");
+            return sizes_[idx];
+        }
+
+        template <typename T>
+        const T* data() const noexcept {
+            static_assert(has_v<T>, "T must be in multi_vector");
+            return static_cast<const T*>(data_ptrs_[idx_v<T>]);
+        }
+
+        template <std::size_t idx>
+        const type_at<idx>* data() const noexcept {
+            static_assert(idx < N, "Index out of bounds");
+            return static_cast<const type_at<idx>*>(data_ptrs_[idx]);
+        }
+
+        template <typename T>
+        column_span<const T> column() const noexcept {
+            return {data<T>(), size<T>()};
+        }
+
+        template <std::size_t idx>
+        column_span<const type_at<idx>> column() const noexcept {
+            return {data<idx>(), size<idx>()};
+        }
+    };
+
+    // O(number of columns) snapshot, independent of the amount of data. The
+    // next write to a column that a snapshot still shares copies that column
+    // only (a "write" is any non-const access to its elements). Snapshotted
+    // columns must be copy-constructible to be written afterwards
+    // (std::logic_error otherwise).
+    snapshot_type snapshot() {
+        share_block(table(), block_align_);
+        snapshot_type snap;
+        share_columns(N, storage_, data_ptrs_, sizes_, snap.storage_, snap.data_ptrs_, snap.sizes_);
+        return snap;
+    }
+
+    // Column i without its type, for tooling that is not templated on the
+    // schema. Throws std::out_of_range unless i < column_count.
+    column_desc column(std::size_t i) const {
+        return columns().at(i);
+    }
+
+    column_descs columns() const noexcept {
+        return {data_ptrs_, sizes_, capacities_, column_traits_, N};
+    }
+
+    template <typename T>
+    std::size_t size() const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return sizes_[idx_v<T>];
+    }
+
+    template <std::size_t idx>
+    std::size_t size() const {
+        static_assert(idx < N, "Index out of bounds");
+        return sizes_[idx];
+    }
+
+    template <typename T>
+    T* data() {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return data<idx_v<T>>();
+    }
+
+    template <typename T>
+    const T* data() const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return static_cast<const T*>(data_ptrs_[idx_v<T>]);
+    }
+
+    template <std::size_t idx>
+    type_at<idx>* data() {
+        static_assert(idx < N, "Index out of bounds");
+        make_column_unique<idx>();
+        return static_cast<type_at<idx>*>(data_ptrs_[idx]);
+    }
+
+    template <std::size_t idx>
+    const type_at<idx>* data() const {
+        static_assert(idx < N, "Index out of bounds");
+        return static_cast<const type_at<idx>*>(data_ptrs_[idx]);
+    }
+
+    template <typename T>
+    std::size_t capacity() const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return capacities_[idx_v<T>];
+    }
+
+    template <std::size_t idx>
+    std::size_t capacity() const {
+        static_assert(idx < N, "Index out of bounds");
+        return capacities_[idx];
+    }
+
+    template <typename T>
+    void push_back(const T& value) {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        push_back<idx_v<T>>(value);
+    }
+
+    template <std::size_t idx>
+    void push_back(const type_at<idx>& value) {
+        static_assert(idx < N, "Index out of bounds");
+        if (size<idx>() >= capacity<idx>()) {
+            if (circular_[idx] && capacity<idx>() > 0) {
+                overwrite_oldest<idx>(value);
+                this->note_push(idx, sizes_[idx]);
+                return;
+            }
+            this->note_failure(idx);
+            throw std::length_error("multi_vector capacity exceeded for this type");
+        }
+        ::new (static_cast<void*>(data<idx>() + size<idx>())) type_at<idx>(value);
+        sizes_[idx]++;
+        this->note_push(idx, sizes_[idx]);
+    }
+
+    // Destroys all elements but keeps the block, so the instance can be
+    // refilled without allocating. A column still shared with a snapshot is
+    // swapped for fresh empty storage instead; that allocation is the only
+    // way clear() can throw (std::bad_alloc, also past a memory budget),
+    // which is why it is not noexcept.
+    void clear() {
+        clear_columns(std::make_index_sequence<N>{});
+    }
+
+    template <typename T>
+    void clear() {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        clear<idx_v<T>>();
+    }
+
+    template <std::size_t idx>
+    void clear() {
+        static_assert(idx < N, "Index out of bounds");
+        heads_[idx] = 0;
+        if (column_shared<idx>()) {
+            detach_column<idx>(false);
+            return;
+        }
+        destroy_elements_at<idx>();
+        sizes_[idx] = 0;
+    }
+
+    // Circular columns: the elements oldest first, as at most two contiguous
+    // spans (the second is empty until the column wraps). Storage order, as
+    // seen by data(), iterators and batches, starts mid-column once a full
+    // column overwrites; order-independent kernels such as col<T>().sum()
+    // and the histograms can keep using the whole column directly.
+    template <typename T>
+    std::array<column_span<const T>, 2> segments() const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return segments<idx_v<T>>();
+    }
+
+    template <std::size_t idx>
+    std::array<column_span<const type_at<idx>>, 2> segments() const {
+        static_assert(idx < N, "Index out of bounds");
+        const type_at<idx>* ptr = data<idx>();
+        const std::size_t head = heads_[idx];
+        return {column_span<const type_at<idx>>(ptr + head, sizes_[idx] - head),
+                column_span<const type_at<idx>>(ptr, head)};
+    }
+
+    // Rotates a wrapped circular column back into oldest-first storage order
+    template <typename T>
+    void linearize() {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        linearize<idx_v<T>>();
+    }
+
+    template <std::size_t idx>
+    void linearize() {
+        static_assert(idx < N, "Index out of bounds");
+        if (heads_[idx] == 0) return;
+        type_at<idx>* ptr = data<idx>();
+        std::rotate(ptr, ptr + heads_[idx], ptr + sizes_[idx]);
+        heads_[idx] = 0;
+    }
+
+    template <typename T>
+    T* begin() {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return data<T>();
+    }
+
+    template <typename T>
+    T* end() {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return data<T>() + size<T>();
+    }
+
+    template <typename T>
+    const T* begin() const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return data<T>();
+    }
+
+    template <typename T>
+    const T* end() const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return data<T>() + size<T>();
+    }
+
+    template <typename T>
+    const T* cbegin() const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return begin<T>();
+    }
+
+    template <typename T>
+    const T* cend() const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return end<T>();
+    }
+
+    template <typename T>
+    std::reverse_iterator<T*> rbegin() {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return std::reverse_iterator<T*>(end<T>());
+    }
+
+    template <typename T>
+    std::reverse_iterator<T*> rend() {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return std::reverse_iterator<T*>(begin<T>());
+    }
+
+    template <typename T>
+    std::reverse_iterator<const T*> rbegin() const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return std::reverse_iterator<const T*>(end<T>());
+    }
+
+    template <typename T>
+    std::reverse_iterator<const T*> rend() const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return std::reverse_iterator<const T*>(begin<T>());
+    }
+
+    template <typename T>
+    std::reverse_iterator<const T*> crbegin() const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return rbegin<T>();
+    }
+
+    template <typename T>
+    std::reverse_iterator<const T*> crend() const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return rend<T>();
+    }
+
+    template <std::size_t idx>
+    type_at<idx>* begin() {
+        static_assert(idx < N, "Index out of bounds");
+        return data<idx>();
+    }
+
+    template <std::size_t idx>
+    type_at<idx>* end() {
+        static_assert(idx < N, "Index out of bounds");
+        return data<idx>() + size<idx>();
+    }
+
+    template <std::size_t idx>
+    const type_at<idx>* begin() const {
+        static_assert(idx < N, "Index out of bounds");
+        return data<idx>();
+    }
+
+    template <std::size_t idx>
+    const type_at<idx>* end() const {
+        static_assert(idx < N, "Index out of bounds");
+        return data<idx>() + size<idx>();
+    }
+
+    template <std::size_t idx>
+    const type_at<idx>* cbegin() const {
+        static_assert(idx < N, "Index out of bounds");
+        return begin<idx>();
+    }
+
+    template <std::size_t idx>
+    const type_at<idx>* cend() const {
+        static_assert(idx < N, "Index out of bounds");
+        return end<idx>();
+    }
+
+    template <std::size_t idx>
+    std::reverse_iterator<type_at<idx>*> rbegin() {
+        static_assert(idx < N, "Index out of bounds");
+        return std::reverse_iterator<type_at<idx>*>(end<idx>());
+    }
+
+    template <std::size_t idx>
+    std::reverse_iterator<type_at<idx>*> rend() {
+        static_assert(idx < N, "Index out of bounds");
+        return std::reverse_iterator<type_at<idx>*>(begin<idx>());
+    }
+
+    template <std::size_t idx>
+    std::reverse_iterator<const type_at<idx>*> rbegin() const {
+        static_assert(idx < N, "Index out of bounds");
+        return std::reverse_iterator<const type_at<idx>*>(end<idx>());
+    }
+
+    template <std::size_t idx>
+    std::reverse_iterator<const type_at<idx>*> rend() const {
+        static_assert(idx < N, "Index out of bounds");
+        return std::reverse_iterator<const type_at<idx>*>(begin<idx>());
+    }
+
+    template <std::size_t idx>
+    std::reverse_iterator<const type_at<idx>*> crbegin() const {
+        static_assert(idx < N, "Index out of bounds");
+        return rbegin<idx>();
+    }
+
+    template <std::size_t idx>
+    std::reverse_iterator<const type_at<idx>*> crend() const {
+        static_assert(idx < N, "Index out of bounds");
+        return rend<idx>();
+    }
+
+    // Removes duplicate elements in place, keeping the first occurrence of each
+    // value and the relative order of the survivors. With `sorted` the column
+    // is assumed sorted and only adjacent duplicates are removed; otherwise
+    // values are deduplicated through a hash table, which needs std::hash<T>
+    // (std::invalid_argument otherwise). Returns the new size.
+    template <typename T>
+    std::size_t unique(bool sorted = false) {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return unique<idx_v<T>>(sorted);
+    }
+
+    template <std::size_t idx>
+    std::size_t unique(bool sorted = false) {
+        static_assert(idx < N, "Index out of bounds");
+        using T = type_at<idx>;
+        linearize<idx>();
+        T* ptr = data<idx>();
+        const std::size_t n = sizes_[idx];
+        std::size_t kept = 0;
+        if (sorted) {
+            kept = static_cast<std::size_t>(std::unique(ptr, ptr + n) - ptr);
+        } else if constexpr (multi_vector_detail::is_hashable_v<T>) {
+            multi_vector_detail::position_set<T> seen(ptr, n);
+            multi_vector_detail::for_each_hash(ptr, n, [&](std::size_t j, std::uint64_t h) {
+                // Survivors are compacted to [0, kept) and are never overwritten
+                // afterwards, so the set can refer to them by position.
+                if (seen.insert(kept, ptr[j], h)) {
+                    if (kept != j) ptr[kept] = std::move(ptr[j]);
+                    ++kept;
+                }
+            });
+        } else {
+            throw std::invalid_argument("multi_vector unique on unsorted input requires std::hash<T>");
+        }
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            for (std::size_t j = kept; j < n; ++j) {
+                ptr[j].~T();
+            }
+        }
+        sizes_[idx] = kept;
+        return kept;
+    }
+
+    // Exact number of distinct values. With `sorted` only adjacent elements
+    // are compared.
+    template <typename T>
+    std::size_t distinct_count(bool sorted = false) const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return distinct_count<idx_v<T>>(sorted);
+    }
+
+    template <std::size_t idx>
+    std::size_t distinct_count(bool sorted = false) const {
+        static_assert(idx < N, "Index out of bounds");
+        using T = type_at<idx>;
+        const T* ptr = data<idx>();
+        const std::size_t n = sizes_[idx];
+        std::size_t count = 0;
+        if (sorted) {
+            for (std::size_t j = 0; j < n; ++j) {
+                if (j == 0 || !(ptr[j] == ptr[j - 1])) ++count;
+            }
+        } else if constexpr (multi_vector_detail::is_hashable_v<T>) {
+            multi_vector_detail::position_set<T> seen(ptr, n);
+            multi_vector_detail::for_each_hash(ptr, n, [&](std::size_t j, std::uint64_t h) {
+                if (seen.insert(j, ptr[j], h)) ++count;
+            });
+        } else {
+            throw std::invalid_argument("multi_vector distinct_count on unsorted input requires std::hash<T>");
+        }
+        return count;
+    }
+
+    // HyperLogLog estimate of the number of distinct values using 2^precision
+    // one-byte registers; the standard error is about 1.04 / sqrt(2^precision).
+    // Throws std::invalid_argument unless 4 <= precision <= 18.
+    template <typename T>
+    std::size_t approx_distinct(unsigned precision = 12) const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return approx_distinct<idx_v<T>>(precision);
+    }
+
+    template <std::size_t idx>
+    std::size_t approx_distinct(unsigned precision = 12) const {
+        static_assert(idx < N, "Index out of bounds");
+        static_assert(multi_vector_detail::is_hashable_v<type_at<idx>>, "approx_distinct requires std::hash<T>");
+        if (precision < 4 || precision > 18) {
+            throw std::invalid_argument("multi_vector approx_distinct precision must be in [4, 18]");
+        }
+        const std::size_t m = std::size_t{1} << precision;
+        std::vector<std::uint8_t> registers(m, 0);
+        multi_vector_detail::for_each_hash(data<idx>(), sizes_[idx], [&](std::size_t, std::uint64_t h) {
+            const std::size_t bucket = static_cast<std::size_t>(h >> (64 - precision));
+            const std::uint64_t rest = h << precision;
+            const auto rank = static_cast<std::uint8_t>(
+                rest ? multi_vector_detail::countl_zero64(rest) + 1 : 64 - precision + 1);
+            if (rank > registers[bucket]) registers[bucket] = rank;
+        });
+
+        double inverse_sum = 0.0;
+        std::size_t zeros = 0;
+        for (std::uint8_t r : registers) {
+            inverse_sum += std::ldexp(1.0, -static_cast<int>(r));
+            zeros += (r == 0);
+        }
+        const double dm = static_cast<double>(m);
+        // Bias correction; the closed form only holds from 128 registers on
+        const double alpha = m == 16 ? 0.673 : m == 32 ? 0.697 : m == 64 ? 0.709 : 0.7213 / (1.0 + 1.079 / dm);
+        double estimate = alpha * dm * dm / inverse_sum;
+        if (estimate <= 2.5 * dm && zeros != 0) {
+            // Linear counting is more accurate while many registers are empty
+            estimate = dm * std::log(dm / static_cast<double>(zeros));
+        }
+        return static_cast<std::size_t>(std::llround(estimate));
+    }
+
+    // Lazy read-only view of a column for building fused expressions, e.g.
+    // `mv.assign<3>(mv.col<0>() * mv.col<1>() + mv.col<2>())` or
+    // `(mv.col<0>() * 2.0).sum()`. Operands must have equal sizes
+    // (std::invalid_argument otherwise).
+    template <typename T>
+    multi_vector_detail::column_ref<T> col() const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return col<idx_v<T>>();
+    }
+
+    template <std::size_t idx>
+    multi_vector_detail::column_ref<type_at<idx>> col() const {
+        static_assert(idx < N, "Index out of bounds");
+        return multi_vector_detail::column_ref<type_at<idx>>(data<idx>(), sizes_[idx]);
+    }
+
+    // Evaluates `expr` in one pass into column T, replacing its contents. The
+    // column may appear in the expression itself. Throws std::length_error if
+    // the result does not fit the capacity.
+    template <typename T, typename Expr>
+    void assign(const Expr& expr) {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        assign<idx_v<T>>(expr);
+    }
+
+    template <std::size_t idx, typename Expr>
+    void assign(const Expr& expr) {
+        static_assert(idx < N, "Index out of bounds");
+        static_assert(multi_vector_detail::is_column_expr_v<Expr>, "assign requires a column expression");
+        overwrite_column<idx>(expr.size(), [&expr](std::size_t j) { return expr[j]; });
+    }
+
+    static constexpr std::size_t default_prefetch_distance = MULTI_VECTOR_PREFETCH_DISTANCE;
+
+    // out[i] = element ids[i] of column T, for every id. Ids must be below
+    // size<T>(); `out` must hold ids.size() assignable elements.
+    template <typename T>
+    void gather(column_span<const std::uint32_t> ids, T* out,
+                std::size_t prefetch_distance = default_prefetch_distance) const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        gather<idx_v<T>>(ids, out, prefetch_distance);
+    }
+
+    template <std::size_t idx>
+    void gather(column_span<const std::uint32_t> ids, type_at<idx>* out,
+                std::size_t prefetch_distance = default_prefetch_distance) const {
+        static_assert(idx < N, "Index out of bounds");
+        multi_vector_detail::gather(data<idx>(), sizes_[idx], ids.data(), ids.size(), prefetch_distance, out);
+    }
+
+    // Element ids[i] of column T = in[i], for every id. Ids must be below
+    // size<T>(); with duplicate ids the last write wins.
+    template <typename T>
+    void scatter(column_span<const std::uint32_t> ids, const T* in,
+                 std::size_t prefetch_distance = default_prefetch_distance) {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        scatter<idx_v<T>>(ids, in, prefetch_distance);
+    }
+
+    template <std::size_t idx>
+    void scatter(column_span<const std::uint32_t> ids, const type_at<idx>* in,
+                 std::size_t prefetch_distance = default_prefetch_distance) {
+        static_assert(idx < N, "Index out of bounds");
+        multi_vector_detail::scatter(data<idx>(), ids.data(), ids.size(), prefetch_distance, in);
+    }
+
+    // Gathers the same ids from several columns, e.g.
+    // `mv.gather_rows<0, 2>(ids, int_out, string_out)`. Ids are processed in
+    // cache-sized chunks, one column at a time, so each column keeps its own
+    // prefetch stream and the chunk of ids stays in L1. The columns are given
+    // explicitly, so a trailing prefetch distance may follow the outputs.
+    template <std::size_t... Is>
+    void gather_rows(column_span<const std::uint32_t> ids, type_at<Is>*... outs,
+                     std::size_t prefetch_distance = default_prefetch_distance) const {
+        static_assert(sizeof...(Is) > 0, "gather_rows needs at least one column");
+        static_assert(((Is < N) && ...), "Index out of bounds");
+        constexpr std::size_t chunk = 1024;
+        for (std::size_t base = 0; base < ids.size(); base += chunk) {
+            const std::size_t len = std::min(chunk, ids.size() - base);
+            (multi_vector_detail::gather(data<Is>(), sizes_[Is], ids.data() + base, len,
+                                         prefetch_distance, outs + base), ...);
+        }
+    }
+
+    // Replaces column Dst with the elements of column Src converted to Dst, in
+    // one bulk pass. Checked and saturating modes require arithmetic types.
+    // Throws std::length_error if the result exceeds Dst's capacity.
+    template <typename Src, typename Dst>
+    void convert(conversion_mode mode = conversion_mode::unchecked) {
+        static_assert(has_v<Src>, "Src must be in multi_vector");
+        static_assert(has_v<Dst>, "Dst must be in multi_vector");
+        convert_into<idx_v<Src>, idx_v<Dst>>(*this, mode);
+    }
+
+    template <std::size_t src_idx, std::size_t dst_idx>
+    void convert(conversion_mode mode = conversion_mode::unchecked) {
+        convert_into<src_idx, dst_idx>(*this, mode);
+    }
+
+    // As convert(), but writes column Dst of another multi_vector.
+    template <typename Src, typename Dst, typename P, typename... Us>
+    void convert_into(basic_multi_vector<P, Us...>& dst, conversion_mode mode = conversion_mode::unchecked) const {
+        static_assert(has_v<Src>, "Src must be in multi_vector");
+        static_assert(basic_multi_vector<P, Us...>::template has_v<Dst>, "Dst must be in the destination multi_vector");
+        convert_into<idx_v<Src>, basic_multi_vector<P, Us...>::template idx_v<Dst>>(dst, mode);
+    }
+
+    template <std::size_t src_idx, std::size_t dst_idx, typename P, typename... Us>
+    void convert_into(basic_multi_vector<P, Us...>& dst, conversion_mode mode = conversion_mode::unchecked) const {
+        static_assert(src_idx < N, "Index out of bounds");
+        static_assert(dst_idx < sizeof...(Us), "Destination index out of bounds");
+        using Src = type_at<src_idx>;
+        using Dst = typename basic_multi_vector<P, Us...>::template type_at<dst_idx>;
+        const Src* src = data<src_idx>();
+        const std::size_t n = sizes_[src_idx];
+
+        if (mode == conversion_mode::unchecked) {
+            dst.template overwrite_column<dst_idx>(n, [src](std::size_t j) { return static_cast<Dst>(src[j]); });
+            return;
+        }
+        if constexpr (std::is_arithmetic_v<Src> && std::is_arithmetic_v<Dst>) {
+            using conv = multi_vector_detail::conversion<Src, Dst>;
+            if (mode == conversion_mode::checked) {
+                bool ok = true;
+                for (std::size_t j = 0; j < n; ++j) {
+                    ok &= conv::in_range(src[j]);
+                }
+                if (!ok) {
+                    throw std::range_error("multi_vector conversion value out of range");
+                }
+                dst.template overwrite_column<dst_idx>(n, [src](std::size_t j) { return static_cast<Dst>(src[j]); });
+            } else {
+                dst.template overwrite_column<dst_idx>(n, [src](std::size_t j) { return conv::saturate(src[j]); });
+            }
+        } else {
+            throw std::invalid_argument("multi_vector checked and saturating conversions require arithmetic types");
+        }
+    }
+
+    // Adds to element i of an atomic_counter column. Safe from any number of
+    // threads alongside other counter updates and reads; counter columns are
+    // updated in place, so snapshots taken earlier see the new values too.
+    template <typename C>
+    typename C::value_type fetch_add(std::size_t i, typename C::value_type v,
+                                     std::memory_order order = std::memory_order_relaxed) {
+        static_assert(has_v<C>, "C must be in multi_vector");
+        return fetch_add<idx_v<C>>(i, v, order);
+    }
+
+    template <std::size_t idx>
+    typename type_at<idx>::value_type fetch_add(std::size_t i, typename type_at<idx>::value_type v,
+                                                std::memory_order order = std::memory_order_relaxed) {
+        static_assert(idx < N, "Index out of bounds");
+        static_assert(multi_vector_detail::is_atomic_counter<type_at<idx>>::value,
+                      "fetch_add requires an atomic_counter column");
+        return static_cast<type_at<idx>*>(data_ptrs_[idx])[i].fetch_add(v, order);
+    }
+
+    // Aggregated value of element i of an atomic_counter column
+    template <typename C>
+    typename C::value_type counter_value(std::size_t i) const {
+        static_assert(has_v<C>, "C must be in multi_vector");
+        return counter_value<idx_v<C>>(i);
+    }
+
+    template <std::size_t idx>
+    typename type_at<idx>::value_type counter_value(std::size_t i) const {
+        static_assert(idx < N, "Index out of bounds");
+        static_assert(multi_vector_detail::is_atomic_counter<type_at<idx>>::value,
+                      "counter_value requires an atomic_counter column");
+        return data<idx>()[i].load();
+    }
+
+    // Sum over every element of an atomic_counter column
+    template <typename C>
+    typename C::value_type counter_total() const {
+        static_assert(has_v<C>, "C must be in multi_vector");
+        return counter_total<idx_v<C>>();
+    }
+
+    template <std::size_t idx>
+    typename type_at<idx>::value_type counter_total() const {
+        static_assert(idx < N, "Index out of bounds");
+        static_assert(multi_vector_detail::is_atomic_counter<type_at<idx>>::value,
+                      "counter_total requires an atomic_counter column");
+        typename type_at<idx>::value_type total{};
+        for (std::size_t i = 0; i < sizes_[idx]; ++i) {
+            total += counter_value<idx>(i);
+        }
+        return total;
+    }
+
+    // Rows per batch such that one batch of every column fills about half of
+    // the L2 cache, leaving the other half for whatever the stages produce.
+    static std::size_t default_batch_rows() {
+        constexpr std::size_t row_bytes = (sizeof(Ts) + ...);
+        return std::max<std::size_t>(16, multi_vector_detail::cache_size(2) / 2 / row_bytes);
+    }
+
+    // Calls f(column_span<Ts>...) for consecutive row ranges of
+    // `batch_rows` rows (0 selects default_batch_rows()), walking all
+    // columns in lockstep. Columns shorter than the batch's first row get
+    // empty spans; iteration ends with the longest column.
+    template <typename F>
+    void for_each_batch(std::size_t batch_rows, F&& f) {
+        make_columns_unique(std::make_index_sequence<N>{});
+        for_each_batch_impl<Ts...>(*this, batch_rows, f, std::make_index_sequence<N>{});
+    }
+
+    template <typename F>
+    void for_each_batch(std::size_t batch_rows, F&& f) const {
+        for_each_batch_impl<const Ts...>(*this, batch_rows, f, std::make_index_sequence<N>{});
+    }
+
+    template <typename F>
+    void for_each_batch(F&& f) {
+        for_each_batch(0, std::forward<F>(f));
+    }
+
+    template <typename F>
+    void for_each_batch(F&& f) const {
+        for_each_batch(0, std::forward<F>(f));
+    }
+
+#if MULTI_VECTOR_HAS_COROUTINES
+    using batch_view = std::tuple<column_span<Ts>...>;
+
+    // Coroutine form of for_each_batch(): yields one batch_view per batch.
+    // The instance must outlive the generator.
+    multi_vector_coro::generator<batch_view> batches(std::size_t batch_rows = 0) {
+        if (batch_rows == 0) batch_rows = default_batch_rows();
+        const std::size_t rows = *std::max_element(std::begin(sizes_), std::end(sizes_));
+        for (std::size_t start = 0; start < rows; start += batch_rows) {
+            co_yield batch_at(start, batch_rows, std::make_index_sequence<N>{});
+        }
+    }
+
+    // Appends values to column T from an asynchronous source until the
+    // column is full or the source runs dry. `source.next()` must return an
+    // awaitable yielding std::optional<T>, empty at the end. Completes with
+    // the number of values appended.
+    template <typename T, typename Source>
+    multi_vector_coro::task<std::size_t> fill_from(Source& source) {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return fill_from<idx_v<T>>(source);
+    }
+
+    template <std::size_t idx, typename Source>
+    multi_vector_coro::task<std::size_t> fill_from(Source& source) {
+        static_assert(idx < N, "Index out of bounds");
+        std::size_t appended = 0;
+        while (sizes_[idx] < capacities_[idx]) {
+            std::optional<type_at<idx>> item = co_await source.next();
+            if (!item) break;
+            push_back<idx>(*item);
+            ++appended;
+        }
+        co_return appended;
+    }
+#endif
+
+    // Counts elements per bucket [bucket_edges[b], bucket_edges[b + 1]); the
+    // last bucket also includes bucket_edges.back(). Values outside the edges
+    // are not counted. Edges must be sorted with at least two entries
+    // (std::invalid_argument otherwise).
+    template <typename T>
+    std::vector<std::size_t> histogram(const std::vector<T>& bucket_edges) const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return histogram<idx_v<T>>(bucket_edges);
+    }
+
+    template <std::size_t idx>
+    std::vector<std::size_t> histogram(const std::vector<type_at<idx>>& bucket_edges) const {
+        static_assert(idx < N, "Index out of bounds");
+        return histogram_on<idx>(bucket_edges, nullptr, 1);
+    }
+
+    // Counts elements into `nbuckets` equal-width buckets over [min, max];
+    // values outside the range are not counted. Requires min < max and
+    // nbuckets > 0 (std::invalid_argument otherwise).
+    template <typename T>
+    std::vector<std::size_t> histogram(T min, T max, std::size_t nbuckets) const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return histogram<idx_v<T>>(min, max, nbuckets);
+    }
+
+    template <std::size_t idx>
+    std::vector<std::size_t> histogram(type_at<idx> min, type_at<idx> max, std::size_t nbuckets) const {
+        static_assert(idx < N, "Index out of bounds");
+        return histogram_on<idx>(min, max, nbuckets, nullptr, 1);
+    }
+
+    // As histogram(), but splits the column across `threads` threads of the
+    // default executor (0: all of them) that each fill a private histogram,
+    // merged at the end.
+    template <typename T>
+    std::vector<std::size_t> parallel_histogram(const std::vector<T>& bucket_edges, std::size_t threads = 0) const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return histogram_on<idx_v<T>>(bucket_edges, nullptr, threads);
+    }
+
+    template <std::size_t idx>
+    std::vector<std::size_t> parallel_histogram(const std::vector<type_at<idx>>& bucket_edges,
+                                                std::size_t threads = 0) const {
+        static_assert(idx < N, "Index out of bounds");
+        return histogram_on<idx>(bucket_edges, nullptr, threads);
+    }
+
+    template <typename T>
+    std::vector<std::size_t> parallel_histogram(T min, T max, std::size_t nbuckets, std::size_t threads = 0) const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return histogram_on<idx_v<T>>(min, max, nbuckets, nullptr, threads);
+    }
+
+    template <std::size_t idx>
+    std::vector<std::size_t> parallel_histogram(type_at<idx> min, type_at<idx> max, std::size_t nbuckets,
+                                                std::size_t threads = 0) const {
+        static_assert(idx < N, "Index out of bounds");
+        return histogram_on<idx>(min, max, nbuckets, nullptr, threads);
+    }
+
+    // The same on `ex` instead of the default executor (threads 0: all of
+    // its threads)
+    template <typename T>
+    std::vector<std::size_t> parallel_histogram(const std::vector<T>& bucket_edges, executor& ex,
+                                                std::size_t threads = 0) const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return histogram_on<idx_v<T>>(bucket_edges, &ex, threads);
+    }
+
+    template <std::size_t idx>
+    std::vector<std::size_t> parallel_histogram(const std::vector<type_at<idx>>& bucket_edges, executor& ex,
+                                                std::size_t threads = 0) const {
+        static_assert(idx < N, "Index out of bounds");
+        return histogram_on<idx>(bucket_edges, &ex, threads);
+    }
+
+    template <typename T>
+    std::vector<std::size_t> parallel_histogram(T min, T max, std::size_t nbuckets, executor& ex,
+                                                std::size_t threads = 0) const {
+        static_assert(has_v<T>, "T must be in multi_vector");
+        return histogram_on<idx_v<T>>(min, max, nbuckets, &ex, threads);
+    }
+
+    template <std::size_t idx>
+    std::vector<std::size_t> parallel_histogram(type_at<idx> min, type_at<idx> max, std::size_t nbuckets,
+                                                executor& ex, std::size_t threads = 0) const {
+        static_assert(idx < N, "Index out of bounds");
+        return histogram_on<idx>(min, max, nbuckets, &ex, threads);
+    }
+
+    struct builder {
+        std::array<std::size_t, N> caps_{};
+        multi_vector_detail::optional_slots<std::index_sequence_for<Ts...>, Ts...> defaults_;
+        std::array<bool, N> circular_{};
+        std::size_t destroy_threads_ = 1;
+        block_reclaimer* reclaimer_ = nullptr;
+        memory_budget* budget_ = nullptr;
+
+        template <typename T>
+        builder& capacity(std::size_t cap) {
+            static_assert(has_v<T>, "T must be in multi_vector");
+            caps_[idx_v<T>] = cap;
+            return *this;
+        }
+
+        template <std::size_t idx>
+        builder& capacity(std::size_t cap) {
+            static_assert(idx < N, "Index out of bounds");
+            caps_[idx] = cap;
+            return *this;
+        }
+
+        template <typename T>
+        builder& default_value(const T& value) {
+            static_assert(has_v<T>, "T must be in multi_vector");
+            return default_value<idx_v<T>>(value);
+        }
+
+        template <std::size_t idx>
+        builder& default_value(const type_at<idx>& value) {
+            static_assert(idx < N, "Index out of bounds");
+            default_at<idx>() = value;
+            return *this;
+        }
+
+        // Destroys large non-trivial columns on `threads` threads of the
+        // default executor (0: all of them) when the instance is destroyed
+        // or cleared
+        builder& parallel_destroy(std::size_t threads = 0) {
+            destroy_threads_ = threads;
+            return *this;
+        }
+
+        // Frees the block on `r`'s background thread once the instance is
+        // destroyed
+        builder& reclaim_with(block_reclaimer& r) {
+            reclaimer_ = &r;
+            return *this;
+        }
+
+        // Draws the block, and later copy-on-write copies, from `b`
+        builder& budget(memory_budget& b) {
+            budget_ = &b;
+            return *this;
+        }
+
+        // Makes push_back on a full column overwrite its oldest element
+        // instead of throwing, keeping the last capacity() values.
+        template <typename T>
+        builder& circular() {
+            static_assert(has_v<T>, "T must be in multi_vector");
+            circular_[idx_v<T>] = true;
+            return *this;
+        }
+
+        template <std::size_t idx>
+        builder& circular() {
+            static_assert(idx < N, "Index out of bounds");
+            circular_[idx] = true;
+            return *this;
+        }
+
+    private:
+        template <std::size_t I>
+        std::optional<type_at<I>>& default_at() noexcept {
+            return static_cast<multi_vector_detail::optional_slot<I, type_at<I>>&>(defaults_).value;
+        }
+
+        template <std::size_t I>
+        const std::optional<type_at<I>>& default_at() const noexcept {
+            return static_cast<const multi_vector_detail::optional_slot<I, type_at<I>>&>(defaults_).value;
+        }
+
+        template <std::size_t... Is>
+        void init_defaults(basic_multi_vector& mv, std::index_sequence<Is...>) const {
+            (init_default_at<Is>(mv), ...);
+        }
+
+        template <std::size_t I>
+        void init_default_at(basic_multi_vector& mv) const {
+            const auto& opt_default = default_at<I>();
+            if (opt_default.has_value()) {
+                using T = type_at<I>;
+                T* ptr = static_cast<T*>(mv.data_ptrs_[I]);
+                for (std::size_t j = 0; j < caps_[I]; ++j) {
+                    ::new (static_cast<void*>(ptr + j)) T(opt_default.value());
+                }
+                mv.sizes_[I] = caps_[I];
+                mv.note_size(I, caps_[I]);
+            }
+        }
+
+    public:
+        basic_multi_vector build() const {
+            basic_multi_vector mv{};
+            std::array<std::size_t, N> offsets{};
+            const std::size_t off =
+                plan_layout(N, caps_.data(), type_sizes_.data(), type_aligns_.data(), offsets.data());
+            multi_vector_detail::trace_span<trace_hook> span("multi_vector::build", off);
+
+            mv.allocate_block(off, block_align_, budget_);
+            if (mv.block_) {
+                place_columns(mv.table(), mv.block_, offsets.data(), caps_.data(), circular_.data());
+                mv.destroy_threads_ = destroy_threads_;
+                mv.reclaimer_ = reclaimer_;
+                multi_vector_detail::trace_span<trace_hook> init_span("multi_vector::init_defaults", off);
+                init_defaults(mv, std::make_index_sequence<N>{});
+            }
+
+            return mv;
+        }
+    };
+};
+
+// Two identically built instances for handing data from one writer thread to
+// any number of readers. The writer fills the back buffer and publishes it
+// with an atomic index flip; readers pin the current front buffer with a
+// counter on its own cache line and never take a lock. Before reusing the
+// old front, the writer waits for its pins to drain and clears it, keeping
+// the block, so a handoff allocates nothing.
 template <typename... Ts>
-class multi_vector {
+class double_buffered_multi_vector {
+public:
+    using vector_type = multi_vector<Ts...>;
 
-    static_assert(sizeof...(Ts) > 0, "multi_vector requires at least one type");
+    // Keeps the front buffer it was created on alive for reading.
+    class read_guard {
+        const double_buffered_multi_vector* owner_ = nullptr;
+        unsigned index_ = 0;
+
+    public:
+        read_guard(const double_buffered_multi_vector* owner, unsigned index) noexcept
+            : owner_(owner), index_(index) {}
+        read_guard(read_guard&& other) noexcept
+            : owner_(std::exchange(other.owner_, nullptr)), index_(other.index_) {}
+        read_guard& operator=(read_guard&&) = delete;
+        ~read_guard() {
+            if (owner_) owner_->pins_[index_].count.fetch_sub(1, std::memory_order_release);
+        }
+
+        const vector_type& operator*() const noexcept { return owner_->buffers_[index_]; }
+        const vector_type* operator->() const noexcept { return &owner_->buffers_[index_]; }
+    };
+
+    explicit double_buffered_multi_vector(const typename vector_type::builder& b)
+        : buffers_{b.build(), b.build()} {}
+
+    double_buffered_multi_vector(const double_buffered_multi_vector&) = delete;
+    double_buffered_multi_vector& operator=(const double_buffered_multi_vector&) = delete;
+
+    // Reader side: pins and returns the current front buffer.
+    read_guard read() const noexcept {
+        for (;;) {
+            const unsigned i = front_.load(std::memory_order_seq_cst);
+            pins_[i].count.fetch_add(1, std::memory_order_seq_cst);
+            // Re-check after pinning: if the writer flipped in between, it may
+            // already have seen no pins on this buffer and started reusing it
+            if (front_.load(std::memory_order_seq_cst) == i) return read_guard(this, i);
+            pins_[i].count.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    // Writer side: the back buffer, without waiting or clearing. Only valid
+    // after acquire_back() since the last publish().
+    vector_type& back() noexcept { return buffers_[front_.load(std::memory_order_relaxed) ^ 1u]; }
+
+    // Writer side: waits until no reader still pins the back buffer (the
+    // front before the last publish), clears it and returns it for filling.
+    vector_type& acquire_back() {
+        const unsigned b = front_.load(std::memory_order_relaxed) ^ 1u;
+        while (pins_[b].count.load(std::memory_order_seq_cst) != 0) {
+            std::this_thread::yield();
+        }
+        buffers_[b].clear();
+        return buffers_[b];
+    }
+
+    // Writer side: makes the back buffer the front buffer.
+    void publish() noexcept {
+        front_.store(front_.load(std::memory_order_relaxed) ^ 1u, std::memory_order_seq_cst);
+    }
+
+private:
+    struct alignas(64) pin_count {
+        std::atomic<std::size_t> count{0};
+    };
+
+    vector_type buffers_[2];
+    alignas(64) std::atomic<unsigned> front_{0};
+    mutable pin_count pins_[2];
+};
+
+// Append-only wrapper for one writer thread and any number of reader
+// threads. The writer constructs elements and then publishes each column's
+// new size with a release store; readers take snapshot()s with acquire loads
+// and scan the published prefixes without locks. Capacity is fixed at build
+// time, so the block never moves while readers are active. Each column is
+// published independently; a snapshot is not a cross-column transaction.
+//
+// Columns of trivial types can also be filled by several writer threads at
+// once through claims: claim_range() reserves a run of slots with one atomic
+// operation, the claiming thread fills it privately, and commit() publishes
+// it once every earlier claim on the column is committed, so readers always
+// see a gap-free prefix. Each thread must commit its claims in the order it
+// made them. push_back() and append() must not overlap claims on the same
+// column.
+template <typename... Ts>
+class append_only_multi_vector {
+public:
+    using vector_type = multi_vector<Ts...>;
+    static constexpr std::size_t N = vector_type::column_count;
+
+    // Slots [begin, end) of one column, reserved by claim_range()
+    struct claimed_range {
+        std::size_t begin = 0;
+        std::size_t end = 0;
+
+        std::size_t size() const noexcept { return end - begin; }
+    };
+
+    // Published sizes at the time snapshot() was called. Valid while the
+    // append_only_multi_vector is alive.
+    class snapshot_type {
+        const vector_type* mv_ = nullptr;
+        std::size_t sizes_[N]{};
+
+        friend class append_only_multi_vector;
+
+    public:
+        template <typename T>
+        std::size_t size() const noexcept {
+            return sizes_[vector_type::template column_index<T>];
+        }
+
+        template <std::size_t I>
+        std::size_t size() const noexcept {
+            static_assert(I < N, "Index out of bounds");
+            return sizes_[I];
+        }
+
+        template <typename T>
+        column_span<const T> column() const noexcept {
+            return column<vector_type::template column_index<T>>();
+        }
+
+        template <std::size_t I>
+        column_span<const typename vector_type::template column_type<I>> column() const noexcept {
+            static_assert(I < N, "Index out of bounds");
+            return {mv_->template data<I>(), sizes_[I]};
+        }
+    };
+
+    explicit append_only_multi_vector(vector_type&& mv) noexcept : mv_(std::move(mv)) {
+        for (std::size_t i = 0; i < N; ++i) {
+            published_[i].store(mv_.sizes_[i], std::memory_order_relaxed);
+            claimed_[i].store(mv_.sizes_[i], std::memory_order_relaxed);
+            // Overwriting would rewrite elements readers are scanning
+            mv_.circular_[i] = false;
+        }
+    }
+
+    explicit append_only_multi_vector(const typename vector_type::builder& b) : append_only_multi_vector(b.build()) {}
+
+    append_only_multi_vector(const append_only_multi_vector&) = delete;
+    append_only_multi_vector& operator=(const append_only_multi_vector&) = delete;
+
+    // Writer side
+    template <typename T>
+    void push_back(const T& value) {
+        push_back<vector_type::template column_index<T>>(value);
+    }
+
+    template <std::size_t I>
+    void push_back(const typename vector_type::template column_type<I>& value) {
+        sync_size<I>();
+        mv_.template push_back<I>(value);
+        publish_size<I>();
+    }
 
-    template <typename T, typename... Us>
-    struct index_of;
+    // Writer side: appends a run of values and publishes them at once.
+    // Throws std::length_error, appending nothing, if they do not fit.
+    template <typename T>
+    void append(column_span<const T> values) {
+        append<vector_type::template column_index<T>>(values);
+    }
+
+    template <std::size_t I>
+    void append(column_span<const typename vector_type::template column_type<I>> values) {
+        sync_size<I>();
+        if (values.size() > mv_.capacities_[I] - mv_.sizes_[I]) {
+            throw std::length_error("multi_vector capacity exceeded for this type");
+        }
+        for (const auto& v : values) {
+            mv_.template push_back<I>(v);
+        }
+        publish_size<I>();
+    }
+
+    // Any writer thread: reserves `n` uninitialized slots at the end of the
+    // column. Throws std::length_error, reserving nothing, if they do not fit.
+    // A claim that does not fit can also fail a concurrent claim that would
+    // have fit, until it has rolled back.
+    template <typename T>
+    claimed_range claim_range(std::size_t n) {
+        return claim_range<vector_type::template column_index<T>>(n);
+    }
+
+    template <std::size_t I>
+    claimed_range claim_range(std::size_t n) {
+        using T = typename vector_type::template column_type<I>;
+        static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_default_constructible_v<T>,
+                      "claims need trivially copyable, trivially default constructible columns");
+        const std::size_t cap = mv_.capacities_[I];
+        if (n > cap) throw std::length_error("multi_vector capacity exceeded for this type");
+        // One fetch_add on the success path, however many threads claim
+        const std::size_t begin = claimed_[I].fetch_add(n, std::memory_order_relaxed);
+        if (begin + n <= cap) return {begin, begin + n};
+        // Overflow. Every claim made after this one overflowed too, so undo
+        // them in reverse order: wait for those to roll back to our end,
+        // then roll back ours. Rolling back out of order could hand out
+        // slots another claim is about to release again.
+        std::size_t expected = begin + n;
+        while (!claimed_[I].compare_exchange_weak(expected, begin, std::memory_order_relaxed)) {
+            expected = begin + n;
+            std::this_thread::yield();
+        }
+        throw std::length_error("multi_vector capacity exceeded for this type");
+    }
+
+    // The slots of a claim, for the claiming thread to fill
+    template <typename T>
+    column_span<T> slots(claimed_range r) const noexcept {
+        return slots<vector_type::template column_index<T>>(r);
+    }
+
+    template <std::size_t I>
+    column_span<typename vector_type::template column_type<I>> slots(claimed_range r) const noexcept {
+        return {column_data<I>() + r.begin, r.size()};
+    }
+
+    // claim_range() followed by slots()
+    template <typename T>
+    column_span<T> claim(std::size_t n) {
+        return claim<vector_type::template column_index<T>>(n);
+    }
+
+    template <std::size_t I>
+    column_span<typename vector_type::template column_type<I>> claim(std::size_t n) {
+        return slots<I>(claim_range<I>(n));
+    }
+
+    // Publishes a filled claim. Waits until all earlier claims on the column
+    // are committed, so a claim that is never committed stalls later ones.
+    template <typename T>
+    void commit_range(claimed_range r) {
+        commit_range<vector_type::template column_index<T>>(r);
+    }
+
+    template <std::size_t I>
+    void commit_range(claimed_range r) {
+        // Acquire keeps the chain of earlier committers' writes visible to
+        // readers of our release store
+        while (published_[I].load(std::memory_order_acquire) != r.begin) {
+            std::this_thread::yield();
+        }
+        published_[I].store(r.end, std::memory_order_release);
+    }
+
+    template <typename T>
+    void commit(column_span<T> claimed) {
+        constexpr std::size_t I = vector_type::template column_index<T>;
+        const auto begin = static_cast<std::size_t>(claimed.data() - column_data<I>());
+        commit_range<I>({begin, begin + claimed.size()});
+    }
+
+    // Reader side
+    snapshot_type snapshot() const noexcept {
+        snapshot_type snap;
+        snap.mv_ = &mv_;
+        for (std::size_t i = 0; i < N; ++i) {
+            snap.sizes_[i] = published_[i].load(std::memory_order_acquire);
+        }
+        return snap;
+    }
+
+    template <typename T>
+    std::size_t published_size() const noexcept {
+        return published_[vector_type::template column_index<T>].load(std::memory_order_acquire);
+    }
+
+    template <std::size_t I>
+    std::size_t capacity() const noexcept {
+        return mv_.capacities_[I];
+    }
+
+private:
+    template <std::size_t I>
+    typename vector_type::template column_type<I>* column_data() const noexcept {
+        return static_cast<typename vector_type::template column_type<I>*>(mv_.data_ptrs_[I]);
+    }
+
+    // Claims may have moved the end of the column past mv_'s own size
+    template <std::size_t I>
+    void sync_size() noexcept {
+        mv_.sizes_[I] = claimed_[I].load(std::memory_order_relaxed);
+    }
+
+    template <std::size_t I>
+    void publish_size() noexcept {
+        claimed_[I].store(mv_.sizes_[I], std::memory_order_relaxed);
+        published_[I].store(mv_.sizes_[I], std::memory_order_release);
+    }
+
+    vector_type mv_;
+    // Away from the writer-private bookkeeping in mv_, and from each other:
+    // claimers hammer claimed_ while readers poll published_
+    alignas(64) std::atomic<std::size_t> published_[N];
+    alignas(64) std::atomic<std::size_t> claimed_[N];
+};
+
+// Holder for an instance that is rebuilt rarely and read constantly. Readers
+// take a guard to the current instance; writers build a replacement and
+// publish it with an atomic pointer swap. Replaced instances are reclaimed
+// with epoch-based reclamation once every reader that might hold them has
+// left its read section. Guards must not outlive the rcu_multi_vector.
+template <typename... Ts>
+class rcu_multi_vector {
+    using domain = multi_vector_detail::rcu_domain;
+
+public:
+    using vector_type = multi_vector<Ts...>;
+
+    class read_guard {
+        domain::reader* rec_ = nullptr;
+        const vector_type* mv_ = nullptr;
+
+    public:
+        read_guard(domain::reader* rec, const vector_type* mv) noexcept : rec_(rec), mv_(mv) {}
+        read_guard(read_guard&& other) noexcept
+            : rec_(std::exchange(other.rec_, nullptr)), mv_(other.mv_) {}
+        read_guard& operator=(read_guard&&) = delete;
+        ~read_guard() {
+            if (rec_) domain::instance().leave(*rec_);
+        }
 
-    template <typename T, typename... Us>
-    struct index_of<T, T, Us...> : std::integral_constant<std::size_t, 0> {};
+        const vector_type& operator*() const noexcept { return *mv_; }
+        const vector_type* operator->() const noexcept { return mv_; }
+    };
 
-    template <typename T, typename U, typename... Us>
-    struct index_of<T, U, Us...>
-        : std::integral_constant<std::size_t, 1 + index_of<T, Us...>::value> {};
+    explicit rcu_multi_vector(vector_type&& initial) : current_(new vector_type(std::move(initial))) {}
 
-    template <typename T>
-    static constexpr std::size_t idx_v = index_of<T, Ts...>::value;
+    explicit rcu_multi_vector(const typename vector_type::builder& b) : rcu_multi_vector(b.build()) {}
 
-    template <std::size_t I>
-    using type_at = std::tuple_element_t<I, std::tuple<Ts...>>;
+    rcu_multi_vector(const rcu_multi_vector&) = delete;
+    rcu_multi_vector& operator=(const rcu_multi_vector&) = delete;
 
-    static constexpr std::size_t N = sizeof...(Ts);
-    using type_tuple = std::tuple<Ts...>;
+    // Requires that no guards are alive. Waits for readers of retired
+    // instances that are still inside unrelated read sections.
+    ~rcu_multi_vector() {
+        synchronize();
+        delete current_.load(std::memory_order_relaxed);
+    }
 
-    static constexpr std::array<std::size_t, N> type_sizes_{sizeof(Ts)...};
-    static constexpr std::array<std::size_t, N> type_aligns_{alignof(Ts)...};
-    static constexpr std::size_t block_align_ = std::max({alignof(Ts)...});
+    read_guard read() const {
+        domain& d = domain::instance();
+        domain::reader& rec = d.local();
+        d.enter(rec);
+        return read_guard(&rec, current_.load(std::memory_order_acquire));
+    }
 
-    static constexpr std::size_t align_up(std::size_t value, std::size_t alignment) {
-        return alignment ? (value + (alignment - 1)) & ~(alignment - 1) : value;
+    // Makes `next` the current instance and retires the previous one, which
+    // is freed as soon as no reader can still hold it. Frees any earlier
+    // retirees whose grace period has passed.
+    void publish(vector_type&& next) {
+        auto* fresh = new vector_type(std::move(next));
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        vector_type* old = current_.exchange(fresh, std::memory_order_acq_rel);
+        retired_.push_back(retired{old, domain::instance().readers_inside()});
+        reclaim_locked();
     }
 
-    template <std::size_t... Is>
-    void destroy_elements(std::index_sequence<Is...>) {
-        (destroy_elements_at<Is>(), ...);
+    // Frees retired instances whose readers are gone; returns how many remain.
+    std::size_t reclaim() {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        return reclaim_locked();
     }
 
-    template <std::size_t I>
-    void destroy_elements_at() {
-        using T = type_at<I>;
-        if constexpr (!std::is_trivially_destructible_v<T>) {
-            T* ptr = static_cast<T*>(data_ptrs_[I]);
-            for (std::size_t j = 0; j < sizes_[I]; ++j) {
-                ptr[j].~T();
-            }
+    // Blocks until every retired instance has been freed. Must not be called
+    // from inside a read section.
+    void synchronize() {
+        while (reclaim() != 0) {
+            std::this_thread::yield();
         }
     }
 
-    void* data_ptrs_[N]{};
-    std::size_t sizes_[N]{};
-    std::size_t capacities_[N]{};
-    void* block_ = nullptr;
-    std::size_t block_size_ = 0;
+private:
+    struct retired {
+        vector_type* mv;
+        std::vector<domain::waiting_reader> waiting;
+    };
 
-    friend struct builder;
+    std::size_t reclaim_locked() {
+        auto it = std::remove_if(retired_.begin(), retired_.end(), [](retired& r) {
+            if (!domain::grace_period_over(r.waiting)) return false;
+            delete r.mv;
+            return true;
+        });
+        retired_.erase(it, retired_.end());
+        return retired_.size();
+    }
 
+    std::atomic<vector_type*> current_;
+    std::mutex writer_mutex_;
+    std::vector<retired> retired_;
+};
+
+// One multi_vector shard per writer thread, all built from the same builder,
+// merged into a single instance at the end. Appending to local() needs no
+// synchronization; each shard keeps the builder's fixed capacities.
+// merge() must not run concurrently with appends.
+template <typename... Ts>
+class sharded_multi_vector {
 public:
-    multi_vector() noexcept = default;
+    using vector_type = multi_vector<Ts...>;
+    using builder_type = typename vector_type::builder;
+    static constexpr std::size_t N = vector_type::column_count;
 
-    ~multi_vector() {
-        if (!block_) return;
-        destroy_elements(std::make_index_sequence<N>{});
-        ::operator delete(block_, std::align_val_t{block_align_});
-    }
+    explicit sharded_multi_vector(builder_type shard_builder)
+        : builder_(std::move(shard_builder)), id_(multi_vector_detail::next_instance_id()) {}
 
-    multi_vector(multi_vector&& other) noexcept
-        : block_(other.block_), block_size_(other.block_size_)
-    {
-        for (std::size_t i = 0; i < N; ++i) {
-            data_ptrs_[i] = other.data_ptrs_[i];
-            sizes_[i] = other.sizes_[i];
-            capacities_[i] = other.capacities_[i];
-            other.data_ptrs_[i] = nullptr;
-            other.sizes_[i] = 0;
-            other.capacities_[i] = 0;
+    sharded_multi_vector(const sharded_multi_vector&) = delete;
+    sharded_multi_vector& operator=(const sharded_multi_vector&) = delete;
+
+    // The calling thread's shard, created on first use. A one-entry
+    // thread-local cache makes repeat calls a compare and a load.
+    vector_type& local() {
+        thread_local shard_cache cache;
+        if (cache.id == id_) return *cache.shard;
+        const std::thread::id me = std::this_thread::get_id();
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = std::find_if(shards_.begin(), shards_.end(), [&](const shard& s) { return s.owner == me; });
+        if (it == shards_.end()) {
+            shards_.push_back(shard{me, std::make_unique<vector_type>(builder_.build())});
+            it = std::prev(shards_.end());
         }
-        other.block_ = nullptr;
-        other.block_size_ = 0;
+        cache = shard_cache{id_, it->mv.get()};
+        return *cache.shard;
+    }
+
+    std::size_t shard_count() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return shards_.size();
     }
 
+    // Total elements of a column across shards
     template <typename T>
     std::size_t size() const {
-        static_assert((std::is_same_v<T, Ts> || ...), "T must be in multi_vector");
-        return sizes_[idx_v<T>];
+        return size<vector_type::template column_index<T>>();
     }
 
-    template <std::size_t idx>
+    template <std::size_t I>
     std::size_t size() const {
-        static_assert(idx < N, "Index out of bounds");
-        return sizes_[idx];
+        static_assert(I < N, "Index out of bounds");
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::size_t total = 0;
+        for (const auto& s : shards_) total += s.mv->sizes_[I];
+        return total;
     }
 
-    template <typename T>
-    T* data() const {
-        static_assert((std::is_same_v<T, Ts> || ...), "T must be in multi_vector");
-        return static_cast<T*>(data_ptrs_[idx_v<T>]);
+    template <typename F>
+    void for_each_shard(F&& f) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& s : shards_) f(static_cast<const vector_type&>(*s.mv));
     }
 
-    template <std::size_t idx>
-    type_at<idx>* data() const {
-        static_assert(idx < N, "Index out of bounds");
-        return static_cast<type_at<idx>*>(data_ptrs_[idx]);
+    // Empties every shard, keeping their blocks for reuse
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& s : shards_) s.mv->clear();
     }
 
-    template <typename T>
-    std::size_t capacity() const {
-        static_assert((std::is_same_v<T, Ts> || ...), "T must be in multi_vector");
-        return capacities_[idx_v<T>];
+    // Concatenates the shards, in creation order, into one instance whose
+    // capacities equal the merged sizes; circular columns are merged oldest
+    // first. The instance keeps the shard builder's budget, reclaim_with()
+    // and parallel_destroy() settings, but not its default values or
+    // circular columns. Trivially copyable columns are
+    // copied with memcpy in parallel chunks on up to `threads` threads of the
+    // default executor (0: all of them); other columns are copy-constructed
+    // by one of those threads meanwhile.
+    vector_type merge(std::size_t threads = 0) const {
+        return merge(default_executor(), threads);
     }
 
-    template <std::size_t idx>
-    std::size_t capacity() const {
-        static_assert(idx < N, "Index out of bounds");
-        return capacities_[idx];
+    // The same on `ex` (threads 0: all of its threads)
+    vector_type merge(executor& ex, std::size_t threads = 0) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        builder_type b = builder_;
+        b.defaults_ = {};
+        b.circular_ = {};
+        std::vector<std::array<std::size_t, N>> offsets(shards_.size());
+        for (std::size_t i = 0; i < N; ++i) {
+            std::size_t total = 0;
+            for (std::size_t s = 0; s < shards_.size(); ++s) {
+                offsets[s][i] = total;
+                total += shards_[s].mv->sizes_[i];
+            }
+            b.caps_[i] = total;
+        }
+        vector_type out = b.build();
+
+        std::vector<copy_task> tasks;
+        plan_copies(out, offsets, tasks, std::make_index_sequence<N>{});
+
+        if (threads == 0) threads = ex.concurrency();
+        threads = std::max<std::size_t>(1, std::min(threads, tasks.size()));
+        std::atomic<std::size_t> next{0};
+        parallel_for(ex, 0, threads, 1, [&](std::size_t lo, std::size_t) {
+            if (lo == 0) copy_non_trivial(out, std::make_index_sequence<N>{});
+            for (std::size_t t; (t = next.fetch_add(1, std::memory_order_relaxed)) < tasks.size();) {
+                std::memcpy(tasks[t].dst, tasks[t].src, tasks[t].bytes);
+            }
+        });
+        set_trivial_sizes(out, std::make_index_sequence<N>{});
+        return out;
     }
 
-    template <typename T>
-    void push_back(const T& value) {
-        static_assert((std::is_same_v<T, Ts> || ...), "T must be in multi_vector");
-        if (size<T>() >= capacity<T>()) {
-            throw std::length_error("multi_vector capacity exceeded for this type");
-        }
-        ::new (static_cast<void*>(data<T>() + size<T>())) T(value);
-        sizes_[idx_v<T>]++;
+private:
+    struct shard {
+        std::thread::id owner;
+        std::unique_ptr<vector_type> mv;
+    };
+
+    struct shard_cache {
+        std::uint64_t id = 0;
+        vector_type* shard = nullptr;
+    };
+
+    struct copy_task {
+        void* dst;
+        const void* src;
+        std::size_t bytes;
+    };
+
+    // Large runs are split so threads share the work of one big shard
+    static constexpr std::size_t copy_chunk = std::size_t{1} << 20;
+
+    template <std::size_t I>
+    static constexpr bool memcpy_column = std::is_trivially_copyable_v<typename vector_type::template column_type<I>>;
+
+    template <std::size_t... Is>
+    void plan_copies(vector_type& out, const std::vector<std::array<std::size_t, N>>& offsets,
+                     std::vector<copy_task>& tasks, std::index_sequence<Is...>) const {
+        (plan_copies_at<Is>(out, offsets, tasks), ...);
     }
 
-    template <std::size_t idx>
-    void push_back(const type_at<idx>& value) {
-        static_assert(idx < N, "Index out of bounds");
-        if (size<idx>() >= capacity<idx>()) {
-            throw std::length_error("multi_vector capacity exceeded for this type");
+    template <std::size_t I>
+    void plan_copies_at(vector_type& out, const std::vector<std::array<std::size_t, N>>& offsets,
+                        std::vector<copy_task>& tasks) const {
+        if constexpr (memcpy_column<I>) {
+            using T = typename vector_type::template column_type<I>;
+            for (std::size_t s = 0; s < shards_.size(); ++s) {
+                auto* dst = reinterpret_cast<unsigned char*>(static_cast<T*>(out.data_ptrs_[I]) + offsets[s][I]);
+                // A wrapped circular shard is two runs, oldest first
+                for (const auto& seg : std::as_const(*shards_[s].mv).template segments<I>()) {
+                    const auto* src = reinterpret_cast<const unsigned char*>(seg.data());
+                    const std::size_t bytes = seg.size() * sizeof(T);
+                    for (std::size_t at = 0; at < bytes; at += copy_chunk) {
+                        tasks.push_back(copy_task{dst + at, src + at, std::min(copy_chunk, bytes - at)});
+                    }
+                    dst += bytes;
+                }
+            }
         }
-        ::new (static_cast<void*>(data<idx>() + size<idx>())) type_at<idx>(value);
-        sizes_[idx]++;
     }
 
-    template <typename T>
-    T* begin() {
-        static_assert((std::is_same_v<T, Ts> || ...), "T must be in multi_vector");
-        return data<T>();
+    template <std::size_t... Is>
+    void copy_non_trivial(vector_type& out, std::index_sequence<Is...>) const {
+        (copy_non_trivial_at<Is>(out), ...);
     }
 
-    template <typename T>
-    T* end() {
-        static_assert((std::is_same_v<T, Ts> || ...), "T must be in multi_vector");
-        return data<T>() + size<T>();
+    template <std::size_t I>
+    void copy_non_trivial_at(vector_type& out) const {
+        if constexpr (!memcpy_column<I>) {
+            for (const auto& s : shards_) {
+                for (const auto& seg : std::as_const(*s.mv).template segments<I>()) {
+                    for (const auto& v : seg) out.template push_back<I>(v);
+                }
+            }
+        }
     }
 
-    template <typename T>
-    const T* begin() const {
-        static_assert((std::is_same_v<T, Ts> || ...), "T must be in multi_vector");
-        return data<T>();
+    template <std::size_t... Is>
+    static void set_trivial_sizes(vector_type& out, std::index_sequence<Is...>) noexcept {
+        ((out.sizes_[Is] = memcpy_column<Is> ? out.capacities_[Is] : out.sizes_[Is]), ...);
     }
 
-    template <typename T>
-    const T* end() const {
-        static_assert((std::is_same_v<T, Ts> || ...), "T must be in multi_vector");
-        return data<T>() + size<T>();
-    }
+    builder_type builder_;
+    const std::uint64_t id_;
+    mutable std::mutex mutex_;
+    std::vector<shard> shards_;
+};
 
-    template <typename T>
-    const T* cbegin() const {
-        static_assert((std::is_same_v<T, Ts> || ...), "T must be in multi_vector");
-        return begin<T>();
-    }
+// Lock-free single-producer single-consumer queue of rows. Every column is
+// a ring of the same power-of-two size, the largest builder capacity rounded
+// up; a row is pushed into and popped from all columns at once. Head and
+// tail live on separate cache lines, and each side keeps a cached copy of
+// the other's index so it only touches the shared line when the cache says
+// the ring is full or empty. Builder default values are ignored.
+template <typename... Ts>
+class spsc_ring_multi_vector {
+public:
+    using vector_type = multi_vector<Ts...>;
+    static constexpr std::size_t N = vector_type::column_count;
 
-    template <typename T>
-    const T* cend() const {
-        static_assert((std::is_same_v<T, Ts> || ...), "T must be in multi_vector");
-        return end<T>();
+    explicit spsc_ring_multi_vector(const typename vector_type::builder& b)
+        : mv_(ring_builder(b).build()), mask_(mv_.template capacity<0>() - 1) {
+        init_columns(std::make_index_sequence<N>{});
     }
 
-    template <typename T>
-    std::reverse_iterator<T*> rbegin() {
-        static_assert((std::is_same_v<T, Ts> || ...), "T must be in multi_vector");
-        return std::reverse_iterator<T*>(end<T>());
-    }
+    spsc_ring_multi_vector(const spsc_ring_multi_vector&) = delete;
+    spsc_ring_multi_vector& operator=(const spsc_ring_multi_vector&) = delete;
 
-    template <typename T>
-    std::reverse_iterator<T*> rend() {
-        static_assert((std::is_same_v<T, Ts> || ...), "T must be in multi_vector");
-        return std::reverse_iterator<T*>(begin<T>());
+    ~spsc_ring_multi_vector() {
+        const std::size_t t = tail_.load(std::memory_order_relaxed);
+        destroy_rows(t, head_.load(std::memory_order_relaxed) - t, std::make_index_sequence<N>{});
     }
 
-    template <typename T>
-    std::reverse_iterator<const T*> rbegin() const {
-        static_assert((std::is_same_v<T, Ts> || ...), "T must be in multi_vector");
-        return std::reverse_iterator<const T*>(end<T>());
-    }
+    std::size_t capacity() const noexcept { return mask_ + 1; }
 
-    template <typename T>
-    std::reverse_iterator<const T*> rend() const {
-        static_assert((std::is_same_v<T, Ts> || ...), "T must be in multi_vector");
-        return std::reverse_iterator<const T*>(begin<T>());
+    // Approximate unless called from the producer or consumer thread
+    std::size_t size() const noexcept {
+        const std::size_t t = tail_.load(std::memory_order_acquire);
+        return head_.load(std::memory_order_acquire) - t;
     }
 
-    template <typename T>
-    std::reverse_iterator<const T*> crbegin() const {
-        static_assert((std::is_same_v<T, Ts> || ...), "T must be in multi_vector");
-        return rbegin<T>();
+    bool empty() const noexcept { return size() == 0; }
+
+    // Producer: copies up to values.size() rows, stopping when the ring is
+    // full, and publishes them at once. Returns the number pushed. All spans
+    // must have the same length (std::invalid_argument otherwise).
+    std::size_t push_n(column_span<const Ts>... values) {
+        const std::size_t n = common_size(values.size()...);
+        const std::size_t h = head_.load(std::memory_order_relaxed);
+        if (capacity() - (h - cached_tail_) < n) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+        }
+        const std::size_t k = std::min(n, capacity() - (h - cached_tail_));
+        if (k == 0) return 0;
+        construct_rows(h, k, std::make_index_sequence<N>{}, values.data()...);
+        head_.store(h + k, std::memory_order_release);
+        return k;
     }
 
-    template <typename T>
-    std::reverse_iterator<const T*> crend() const {
-        static_assert((std::is_same_v<T, Ts> || ...), "T must be in multi_vector");
-        return rend<T>();
+    bool try_push(const Ts&... row) {
+        return push_n(column_span<const Ts>(&row, 1)...) == 1;
     }
 
-    template <std::size_t idx>
-    type_at<idx>* begin() {
-        static_assert(idx < N, "Index out of bounds");
-        return data<idx>();
+    // Consumer: moves up to out.size() rows into the spans, which must have
+    // the same length, and frees their slots. Returns the number popped.
+    std::size_t pop_n(column_span<Ts>... out) {
+        const std::size_t n = common_size(out.size()...);
+        const std::size_t t = tail_.load(std::memory_order_relaxed);
+        if (cached_head_ - t < n) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+        }
+        const std::size_t k = std::min(n, cached_head_ - t);
+        if (k == 0) return 0;
+        move_rows(t, k, std::make_index_sequence<N>{}, out.data()...);
+        tail_.store(t + k, std::memory_order_release);
+        return k;
     }
 
-    template <std::size_t idx>
-    type_at<idx>* end() {
-        static_assert(idx < N, "Index out of bounds");
-        return data<idx>() + size<idx>();
+    bool try_pop(Ts&... row) {
+        return pop_n(column_span<Ts>(&row, 1)...) == 1;
     }
 
-    template <std::size_t idx>
-    const type_at<idx>* begin() const {
-        static_assert(idx < N, "Index out of bounds");
-        return data<idx>();
+private:
+    static typename vector_type::builder ring_builder(const typename vector_type::builder& b) {
+        const std::size_t largest = *std::max_element(b.caps_.begin(), b.caps_.end());
+        if (largest == 0) {
+            throw std::invalid_argument("spsc_ring_multi_vector needs a nonzero capacity");
+        }
+        std::size_t ring = 1;
+        while (ring < largest) ring <<= 1;
+        // Keeps the budget, reclaimer and destruction settings
+        typename vector_type::builder out = b;
+        out.caps_.fill(ring);
+        out.defaults_ = {};
+        out.circular_ = {};
+        return out;
     }
 
-    template <std::size_t idx>
-    const type_at<idx>* end() const {
-        static_assert(idx < N, "Index out of bounds");
-        return data<idx>() + size<idx>();
+    template <typename... Sizes>
+    static std::size_t common_size(std::size_t first, Sizes... rest) {
+        if (((rest != first) || ...)) {
+            throw std::invalid_argument("spsc_ring_multi_vector spans must have equal lengths");
+        }
+        return first;
     }
 
-    template <std::size_t idx>
-    const type_at<idx>* cbegin() const {
-        static_assert(idx < N, "Index out of bounds");
-        return begin<idx>();
+    template <std::size_t... Is>
+    void init_columns(std::index_sequence<Is...>) noexcept {
+        ((std::get<Is>(cols_) = mv_.template data<Is>()), ...);
     }
 
-    template <std::size_t idx>
-    const type_at<idx>* cend() const {
-        static_assert(idx < N, "Index out of bounds");
-        return end<idx>();
+    // Calls f(ring offset, span offset, count) for the at most two
+    // contiguous pieces of the `k` slots starting at position `from`
+    template <typename F>
+    void for_each_piece(std::size_t from, std::size_t k, F&& f) const {
+        const std::size_t first = from & mask_;
+        const std::size_t len = std::min(k, capacity() - first);
+        f(first, 0, len);
+        if (len < k) f(0, len, k - len);
     }
 
-    template <std::size_t idx>
-    std::reverse_iterator<type_at<idx>*> rbegin() {
-        static_assert(idx < N, "Index out of bounds");
-        return std::reverse_iterator<type_at<idx>*>(end<idx>());
+    template <std::size_t I>
+    void construct_column(std::size_t h, std::size_t k, const typename vector_type::template column_type<I>* src) {
+        using T = typename vector_type::template column_type<I>;
+        T* ring = std::get<I>(cols_);
+        for_each_piece(h, k, [&](std::size_t at, std::size_t from, std::size_t len) {
+            if constexpr (std::is_trivially_copyable_v<T>) {
+                std::memcpy(static_cast<void*>(ring + at), src + from, len * sizeof(T));
+            } else {
+                std::size_t j = 0;
+                try {
+                    for (; j < len; ++j) ::new (static_cast<void*>(ring + at + j)) T(src[from + j]);
+                } catch (...) {
+                    destroy_column<I>(h, from + j);
+                    throw;
+                }
+            }
+        });
     }
 
-    template <std::size_t idx>
-    std::reverse_iterator<type_at<idx>*> rend() {
-        static_assert(idx < N, "Index out of bounds");
-        return std::reverse_iterator<type_at<idx>*>(begin<idx>());
+    template <std::size_t... Is, typename... Ptrs>
+    void construct_rows(std::size_t h, std::size_t k, std::index_sequence<Is...>, Ptrs... src) {
+        std::size_t done = 0;
+        try {
+            ((construct_column<Is>(h, k, src), ++done), ...);
+        } catch (...) {
+            ((Is < done ? destroy_column<Is>(h, k) : void()), ...);
+            throw;
+        }
     }
 
-    template <std::size_t idx>
-    std::reverse_iterator<const type_at<idx>*> rbegin() const {
-        static_assert(idx < N, "Index out of bounds");
-        return std::reverse_iterator<const type_at<idx>*>(end<idx>());
+    template <std::size_t I>
+    void destroy_column(std::size_t from, std::size_t k) noexcept {
+        using T = typename vector_type::template column_type<I>;
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            T* ring = std::get<I>(cols_);
+            for_each_piece(from, k, [&](std::size_t at, std::size_t, std::size_t len) {
+                for (std::size_t j = 0; j < len; ++j) ring[at + j].~T();
+            });
+        }
     }
 
-    template <std::size_t idx>
-    std::reverse_iterator<const type_at<idx>*> rend() const {
-        static_assert(idx < N, "Index out of bounds");
-        return std::reverse_iterator<const type_at<idx>*>(begin<idx>());
+    template <std::size_t... Is>
+    void destroy_rows(std::size_t from, std::size_t k, std::index_sequence<Is...>) noexcept {
+        (destroy_column<Is>(from, k), ...);
     }
 
-    template <std::size_t idx>
-    std::reverse_iterator<const type_at<idx>*> crbegin() const {
-        static_assert(idx < N, "Index out of bounds");
-        return rbegin<idx>();
+    template <std::size_t I>
+    void move_column(std::size_t t, std::size_t k, typename vector_type::template column_type<I>* dst) {
+        using T = typename vector_type::template column_type<I>;
+        T* ring = std::get<I>(cols_);
+        for_each_piece(t, k, [&](std::size_t at, std::size_t to, std::size_t len) {
+            if constexpr (std::is_trivially_copyable_v<T>) {
+                std::memcpy(static_cast<void*>(dst + to), ring + at, len * sizeof(T));
+            } else {
+                for (std::size_t j = 0; j < len; ++j) {
+                    dst[to + j] = std::move(ring[at + j]);
+                    ring[at + j].~T();
+                }
+            }
+        });
     }
 
-    template <std::size_t idx>
-    std::reverse_iterator<const type_at<idx>*> crend() const {
-        static_assert(idx < N, "Index out of bounds");
-        return rend<idx>();
+    template <std::size_t... Is, typename... Ptrs>
+    void move_rows(std::size_t t, std::size_t k, std::index_sequence<Is...>, Ptrs... dst) {
+        (move_column<Is>(t, k, dst), ...);
     }
 
-    struct builder {
-        std::array<std::size_t, N> caps_{};
-        std::tuple<std::optional<Ts>...> defaults_;
+    vector_type mv_;
+    std::tuple<Ts*...> cols_;
+    const std::size_t mask_;
+    // Producer-owned line
+    alignas(64) std::atomic<std::size_t> head_{0};
+    std::size_t cached_tail_ = 0;
+    // Consumer-owned line
+    alignas(64) std::atomic<std::size_t> tail_{0};
+    std::size_t cached_head_ = 0;
+};
 
-        template <typename T>
-        builder& capacity(std::size_t cap) {
-            static_assert((std::is_same_v<T, Ts> || ...), "T must be in multi_vector");
-            caps_[idx_v<T>] = cap;
-            return *this;
-        }
+#if MULTI_VECTOR_HAS_COROUTINES
+namespace multi_vector_coro {
 
-        template <std::size_t idx>
-        builder& capacity(std::size_t cap) {
-            static_assert(idx < N, "Index out of bounds");
-            caps_[idx] = cap;
-            return *this;
-        }
+// Bounded set of identically built instances that pipeline stages pass
+// along. acquire() suspends while all instances are in flight; a released
+// instance is cleared (keeping its block) and handed to the next waiter, so
+// steady-state streaming allocates nothing. Waiters are resumed on the
+// releasing thread.
+template <typename... Ts>
+class batch_pool {
+public:
+    using vector_type = multi_vector<Ts...>;
 
-        template <typename T>
-        builder& default_value(const T& value) {
-            static_assert((std::is_same_v<T, Ts> || ...), "T must be in multi_vector");
-            std::get<idx_v<T>>(defaults_) = value;
-            return *this;
-        }
+    class lease {
+        batch_pool* pool_ = nullptr;
+        std::size_t slot_ = 0;
 
-        template <std::size_t idx>
-        builder& default_value(const type_at<idx>& value) {
-            static_assert(idx < N, "Index out of bounds");
-            std::get<idx>(defaults_) = value;
+    public:
+        lease() noexcept = default;
+        lease(batch_pool* pool, std::size_t slot) noexcept : pool_(pool), slot_(slot) {}
+        lease(lease&& other) noexcept : pool_(std::exchange(other.pool_, nullptr)), slot_(other.slot_) {}
+        lease& operator=(lease&& other) noexcept {
+            if (this != &other) {
+                reset();
+                pool_ = std::exchange(other.pool_, nullptr);
+                slot_ = other.slot_;
+            }
             return *this;
         }
+        ~lease() { reset(); }
 
-    private:
-        template <std::size_t... Is>
-        void init_defaults(multi_vector& mv, std::index_sequence<Is...>) const {
-            (init_default_at<Is>(mv), ...);
+        vector_type& operator*() const noexcept { return pool_->slots_[slot_]; }
+        vector_type* operator->() const noexcept { return &pool_->slots_[slot_]; }
+        explicit operator bool() const noexcept { return pool_ != nullptr; }
+
+        // Returns the instance to the pool early
+        void reset() {
+            if (pool_) std::exchange(pool_, nullptr)->release(slot_);
         }
+    };
 
-        template <std::size_t I>
-        void init_default_at(multi_vector& mv) const {
-            const auto& opt_default = std::get<I>(defaults_);
-            if (opt_default.has_value()) {
-                using T = type_at<I>;
-                T* ptr = static_cast<T*>(mv.data_ptrs_[I]);
-                for (std::size_t j = 0; j < caps_[I]; ++j) {
-                    ::new (static_cast<void*>(ptr + j)) T(opt_default.value());
-                }
-                mv.sizes_[I] = caps_[I];
-            }
+    batch_pool(const typename vector_type::builder& b, std::size_t max_in_flight) {
+        if (max_in_flight == 0) {
+            throw std::invalid_argument("batch_pool needs at least one instance");
         }
+        slots_.reserve(max_in_flight);
+        for (std::size_t i = 0; i < max_in_flight; ++i) {
+            slots_.push_back(b.build());
+            free_.push_back(i);
+        }
+    }
 
-    public:
-        multi_vector build() const {
-            multi_vector mv{};
-            std::array<std::size_t, N> offsets{};
-            std::size_t off = 0;
-            for (std::size_t i = 0; i < N; ++i) {
-                off = align_up(off, type_aligns_[i]);
-                offsets[i] = off;
-                off += caps_[i] * type_sizes_[i];
-            }
+    batch_pool(const batch_pool&) = delete;
+    batch_pool& operator=(const batch_pool&) = delete;
 
-            void* block = ::operator new(off, std::align_val_t{block_align_});
-            mv.block_ = block;
-            if (block) {
-                for (std::size_t i = 0; i < N; ++i) {
-                    mv.data_ptrs_[i] = static_cast<void*>(reinterpret_cast<std::byte*>(block) + offsets[i]);
-                    mv.capacities_[i] = caps_[i];
+    auto acquire() {
+        struct awaiter {
+            batch_pool* pool;
+            std::size_t slot = 0;
+
+            bool await_ready() {
+                std::lock_guard<std::mutex> lock(pool->mutex_);
+                if (pool->free_.empty()) return false;
+                slot = pool->free_.back();
+                pool->free_.pop_back();
+                return true;
+            }
+            bool await_suspend(std::coroutine_handle<> h) {
+                std::lock_guard<std::mutex> lock(pool->mutex_);
+                if (!pool->free_.empty()) {
+                    slot = pool->free_.back();
+                    pool->free_.pop_back();
+                    return false;
                 }
-                mv.block_size_ = off;
-                init_defaults(mv, std::make_index_sequence<N>{});
+                pool->waiters_.push_back(waiter{h, &slot});
+                return true;
             }
+            lease await_resume() noexcept { return lease(pool, slot); }
+        };
+        return awaiter{this};
+    }
 
-            return mv;
-        }
+    std::size_t available() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return free_.size();
+    }
+
+    // Coroutines suspended in acquire() until an instance is returned
+    std::size_t waiting() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return waiters_.size();
+    }
+
+private:
+    struct waiter {
+        std::coroutine_handle<> handle;
+        std::size_t* slot;
     };
-};
\ No newline at end of file
+
+    void release(std::size_t slot) {
+        slots_[slot].clear();
+        std::coroutine_handle<> next;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (waiters_.empty()) {
+                free_.push_back(slot);
+                return;
+            }
+            *waiters_.front().slot = slot;
+            next = waiters_.front().handle;
+            waiters_.pop_front();
+        }
+        next.resume();
+    }
+
+    std::vector<vector_type> slots_;
+    std::vector<std::size_t> free_;
+    std::deque<waiter> waiters_;
+    mutable std::mutex mutex_;
+};
+
+} // namespace multi_vector_coro
+#endif
@@ -1,5 +1,13 @@
 #include <gtest/gtest.h>
+#include <atomic>
+#include <cmath>
 #include <string>
+#include <system_error>
+#include <thread>
+#if __cplusplus >= 202002L
+#include <ranges>
+#endif
+
 #include "multi_vector.hpp"
 
 // Tracked type to monitor construction/destruction
@@ -21,6 +29,7 @@ struct Tracked {
     ~Tracked() { ++dtor_count; }
 
     bool operator==(int v) const { return value == v; }
+    bool operator==(const Tracked& other) const { return value == other.value; }
 };
 
 int Tracked::ctor_count = 0;
@@ -453,3 +462,1412 @@ TEST(MultiVector, Iterators) {
         EXPECT_EQ(*rsb2, "world");
     }
 }
+
+TEST(MultiVector, UniqueUnsortedKeepsFirstOccurrence) {
+    MV vec = MV::builder()
+        .capacity<int>(8)
+        .capacity<double>(4)
+        .capacity<std::string>(6)
+        .build();
+
+    for (int v : {3, 1, 3, 2, 1, 3, 4, 2}) vec.push_back<int>(v);
+    for (const char* s : {"b", "a", "b", "c", "a", "b"}) vec.push_back<std::string>(s);
+    vec.push_back<double>(0.0);
+    vec.push_back<double>(-0.0);
+
+    EXPECT_EQ(vec.distinct_count<int>(), 4u);
+    EXPECT_EQ(vec.unique<int>(), 4u);
+    ASSERT_EQ(vec.size<int>(), 4u);
+    EXPECT_EQ(vec.data<int>()[0], 3);
+    EXPECT_EQ(vec.data<int>()[1], 1);
+    EXPECT_EQ(vec.data<int>()[2], 2);
+    EXPECT_EQ(vec.data<int>()[3], 4);
+
+    EXPECT_EQ(vec.unique<2>(), 3u);
+    EXPECT_EQ(vec.data<std::string>()[0], "b");
+    EXPECT_EQ(vec.data<std::string>()[1], "a");
+    EXPECT_EQ(vec.data<std::string>()[2], "c");
+
+    // +0.0 and -0.0 compare equal
+    EXPECT_EQ(vec.distinct_count<double>(), 1u);
+
+    // Freed slots can be reused
+    vec.push_back<int>(9);
+    EXPECT_EQ(vec.size<int>(), 5u);
+}
+
+TEST(MultiVector, UniqueSortedAndDistinctCount) {
+    Tracked::reset_counts();
+    {
+        auto vec = multi_vector<Tracked>::builder().capacity<Tracked>(6).build();
+        for (int v : {1, 1, 2, 2, 2, 5}) vec.push_back<Tracked>(Tracked(v));
+        EXPECT_EQ(vec.distinct_count<0>(true), 3u);
+        EXPECT_EQ(vec.unique<Tracked>(true), 3u);
+        EXPECT_EQ(vec.data<Tracked>()[2], 5);
+        // 6 temporaries and the 3 removed tail elements are destroyed
+        EXPECT_EQ(Tracked::dtor_count, 9);
+    }
+    EXPECT_EQ(Tracked::ctor_count, Tracked::dtor_count);
+}
+
+TEST(MultiVector, ApproxDistinctIsClose) {
+    auto vec = multi_vector<std::uint64_t>::builder().capacity<std::uint64_t>(200000).build();
+    for (std::uint64_t i = 0; i < 200000; ++i) vec.push_back<std::uint64_t>(i % 50000);
+
+    EXPECT_EQ(vec.distinct_count<std::uint64_t>(), 50000u);
+    const double estimate = static_cast<double>(vec.approx_distinct<std::uint64_t>(14));
+    EXPECT_NEAR(estimate, 50000.0, 50000.0 * 0.03);
+
+    auto small = multi_vector<int>::builder().capacity<int>(3).build();
+    small.push_back<int>(1);
+    small.push_back<int>(2);
+    small.push_back<int>(1);
+    EXPECT_EQ(small.approx_distinct<int>(), 2u);
+    EXPECT_THROW(small.approx_distinct<int>(2), std::invalid_argument);
+
+    // 16 to 64 registers use tabulated bias corrections. One estimate is
+    // off by 13-26% there, so check the mean over disjoint value sets.
+    auto few = multi_vector<std::uint64_t>::builder().capacity<std::uint64_t>(20000).build();
+    for (unsigned precision = 4; precision <= 6; ++precision) {
+        double sum = 0.0;
+        for (std::uint64_t set = 0; set < 32; ++set) {
+            few.clear();
+            for (std::uint64_t i = 0; i < 20000; ++i) few.push_back<std::uint64_t>(set * 1000000 + i);
+            sum += static_cast<double>(few.approx_distinct<std::uint64_t>(precision));
+        }
+        EXPECT_NEAR(sum / 32.0, 20000.0, 20000.0 * 0.1) << "precision " << precision;
+    }
+}
+
+TEST(MultiVector, HistogramFixedWidth) {
+    auto vec = multi_vector<double, std::uint32_t>::builder()
+        .capacity<double>(8)
+        .capacity<std::uint32_t>(1000)
+        .build();
+
+    for (double v : {0.0, 0.5, 1.0, 2.5, 9.99, 10.0, -1.0, 11.0}) vec.push_back<double>(v);
+    auto counts = vec.histogram<double>(0.0, 10.0, 5);
+    ASSERT_EQ(counts.size(), 5u);
+    EXPECT_EQ(counts[0], 3u);  // 0.0, 0.5, 1.0
+    EXPECT_EQ(counts[1], 1u);  // 2.5
+    EXPECT_EQ(counts[2], 0u);
+    EXPECT_EQ(counts[3], 0u);
+    EXPECT_EQ(counts[4], 2u);  // 9.99 and the closed upper bound 10.0
+
+    for (std::uint32_t i = 0; i < 1000; ++i) vec.push_back<std::uint32_t>(i % 100);
+    auto serial = vec.histogram<1>(0u, 100u, 10);
+    auto parallel = vec.parallel_histogram<std::uint32_t>(0u, 100u, 10, 3);
+    EXPECT_EQ(serial, parallel);
+    for (std::size_t c : serial) EXPECT_EQ(c, 100u);
+
+    EXPECT_THROW(vec.histogram<double>(1.0, 1.0, 4), std::invalid_argument);
+
+    // (x - lo) * scale rounds up to nbuckets for values just below hi
+    auto edge = multi_vector<double>::builder().capacity<double>(3).build();
+    edge.push_back<double>(0.6999999999999998);
+    edge.push_back<double>(0.7);
+    edge.push_back<double>(std::nan(""));
+    auto edge_counts = edge.histogram<double>(0.06, 0.7, 7);
+    std::size_t binned = 0;
+    for (std::size_t c : edge_counts) binned += c;
+    EXPECT_EQ(binned, 2u);
+    EXPECT_EQ(edge_counts[6], 2u);
+}
+
+TEST(MultiVector, HistogramBucketEdges) {
+    auto vec = multi_vector<double>::builder().capacity<double>(5000).build();
+    for (int i = 0; i < 5000; ++i) vec.push_back<double>(i * 0.01);  // [0, 50)
+
+    auto counts = vec.histogram<double>({0.0, 1.0, 10.0, 49.99});
+    ASSERT_EQ(counts.size(), 3u);
+    EXPECT_EQ(counts[0], 100u);
+    EXPECT_EQ(counts[1], 900u);
+    EXPECT_EQ(counts[2], 4000u);  // includes the closed upper edge
+
+    std::vector<double> many_edges;
+    for (int e = 0; e <= 100; ++e) many_edges.push_back(e * 0.5);
+    auto serial = vec.histogram<0>(many_edges);
+    EXPECT_EQ(serial, vec.parallel_histogram<double>(many_edges, 4));
+    EXPECT_EQ(serial[0], 50u);
+
+    EXPECT_THROW(vec.histogram<double>({2.0, 1.0}), std::invalid_argument);
+}
+
+TEST(MultiVector, FusedColumnExpressions) {
+    auto vec = multi_vector<double, float, int, double>::builder()
+        .capacity<0>(4)
+        .capacity<1>(4)
+        .capacity<2>(4)
+        .capacity<3>(4)
+        .build();
+
+    for (int i = 1; i <= 4; ++i) {
+        vec.push_back<0>(i * 1.5);
+        vec.push_back<1>(static_cast<float>(i));
+        vec.push_back<2>(10 * i);
+    }
+    vec.push_back<3>(-1.0);  // overwritten by assign
+
+    vec.assign<3>(vec.col<0>() * vec.col<1>() + vec.col<2>());
+    ASSERT_EQ(vec.size<3>(), 4u);
+    for (int i = 1; i <= 4; ++i) {
+        EXPECT_DOUBLE_EQ(vec.data<3>()[i - 1], i * 1.5 * i + 10 * i);
+    }
+
+    // Scalars broadcast; the destination may appear in its own expression
+    vec.assign<int>(-(vec.col<int>() / 2) + 1);
+    EXPECT_EQ(vec.data<int>()[0], -4);
+    EXPECT_EQ(vec.data<int>()[3], -19);
+
+    EXPECT_DOUBLE_EQ((vec.col<0>() * 2.0).sum(), 30.0);
+    EXPECT_DOUBLE_EQ(vec.col<1>().reduce(1.0, std::multiplies<>()), 24.0);
+
+    float out[4];
+    (vec.col<float>() - 1.0f).eval_into(out);
+    EXPECT_FLOAT_EQ(out[3], 3.0f);
+
+    auto small = multi_vector<int, double>::builder().capacity<int>(2).capacity<double>(1).build();
+    small.push_back<int>(1);
+    small.push_back<int>(2);
+    small.push_back<double>(1.0);
+    EXPECT_THROW(small.col<int>() + small.col<double>(), std::invalid_argument);
+    EXPECT_THROW(small.assign<double>(small.col<int>() * 2), std::length_error);
+}
+
+TEST(MultiVector, GatherScatter) {
+    auto vec = multi_vector<int, double, std::string>::builder()
+        .capacity<int>(1000)
+        .capacity<double>(1000)
+        .capacity<std::string>(1000)
+        .build();
+
+    for (int i = 0; i < 1000; ++i) {
+        vec.push_back<int>(i);
+        vec.push_back<double>(i * 0.5);
+        vec.push_back<std::string>(std::to_string(i));
+    }
+
+    std::vector<std::uint32_t> ids;
+    for (std::uint32_t i = 0; i < 300; ++i) ids.push_back((i * 617u) % 1000u);
+
+    std::vector<int> ints(ids.size());
+    vec.gather<int>(ids, ints.data());
+    std::vector<double> doubles(ids.size());
+    vec.gather<1>(ids, doubles.data(), 4);
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+        EXPECT_EQ(ints[i], static_cast<int>(ids[i]));
+        EXPECT_DOUBLE_EQ(doubles[i], ids[i] * 0.5);
+    }
+
+    std::vector<int> row_ints(ids.size());
+    std::vector<std::string> row_strings(ids.size());
+    vec.gather_rows<0, 2>(ids, row_ints.data(), row_strings.data());
+    EXPECT_EQ(row_ints, ints);
+    EXPECT_EQ(row_strings[7], std::to_string(ids[7]));
+    std::vector<double> row_doubles(ids.size());
+    vec.gather_rows<0, 1>(ids, row_ints.data(), row_doubles.data(), 0);
+    EXPECT_EQ(row_ints, ints);
+    EXPECT_EQ(row_doubles, doubles);
+
+    std::vector<int> negated(ints.size());
+    for (std::size_t i = 0; i < ints.size(); ++i) negated[i] = -ints[i];
+    vec.scatter<int>(ids, negated.data());
+    EXPECT_EQ(vec.data<int>()[ids[5]], -static_cast<int>(ids[5]));
+    EXPECT_EQ(vec.data<int>()[1], 1);  // 1 is not among the ids
+
+    std::vector<std::string> words(2, "x");
+    std::vector<std::uint32_t> few{3, 3};
+    vec.scatter<std::string>(column_span<const std::uint32_t>(few.data(), few.size()), words.data(), 0);
+    EXPECT_EQ(vec.data<std::string>()[3], "x");
+}
+
+TEST(MultiVector, ConvertBetweenColumns) {
+    auto vec = multi_vector<std::int32_t, double, std::int64_t, std::uint8_t>::builder()
+        .capacity<std::int32_t>(4)
+        .capacity<double>(4)
+        .capacity<std::int64_t>(4)
+        .capacity<std::uint8_t>(4)
+        .build();
+
+    for (std::int32_t v : {1, -2, 300, 7}) vec.push_back<std::int32_t>(v);
+    vec.convert<std::int32_t, double>();
+    ASSERT_EQ(vec.size<double>(), 4u);
+    EXPECT_DOUBLE_EQ(vec.data<double>()[1], -2.0);
+
+    // Narrowing: checked mode rejects out-of-range values without writing
+    vec.push_back<std::uint8_t>(9);
+    EXPECT_THROW((vec.convert<std::int32_t, std::uint8_t>(conversion_mode::checked)), std::range_error);
+    EXPECT_EQ(vec.size<std::uint8_t>(), 1u);
+    EXPECT_EQ(vec.data<std::uint8_t>()[0], 9);
+
+    vec.convert<0, 3>(conversion_mode::saturating);
+    ASSERT_EQ(vec.size<3>(), 4u);
+    EXPECT_EQ(vec.data<3>()[0], 1);
+    EXPECT_EQ(vec.data<3>()[1], 0);
+    EXPECT_EQ(vec.data<3>()[2], 255);
+    EXPECT_EQ(vec.data<3>()[3], 7);
+
+    auto out = multi_vector<std::int32_t, std::string>::builder()
+        .capacity<std::int32_t>(4)
+        .capacity<std::string>(1)
+        .build();
+    vec.push_back<std::int64_t>(std::int64_t{1} << 40);
+    vec.push_back<std::int64_t>(-5);
+    EXPECT_THROW((vec.convert_into<std::int64_t, std::int32_t>(out, conversion_mode::checked)), std::range_error);
+    vec.convert_into<std::int64_t, std::int32_t>(out, conversion_mode::saturating);
+    ASSERT_EQ(out.size<std::int32_t>(), 2u);
+    EXPECT_EQ(out.data<std::int32_t>()[0], std::numeric_limits<std::int32_t>::max());
+    EXPECT_EQ(out.data<std::int32_t>()[1], -5);
+}
+
+TEST(MultiVector, ConvertFloatingPoint) {
+    auto vec = multi_vector<double, std::int16_t, float>::builder()
+        .capacity<double>(5)
+        .capacity<std::int16_t>(5)
+        .capacity<float>(5)
+        .build();
+    for (double v : {-1.9, 40000.0, std::nan(""), 12.7, -40000.0}) vec.push_back<double>(v);
+
+    EXPECT_THROW((vec.convert<double, std::int16_t>(conversion_mode::checked)), std::range_error);
+    vec.convert<double, std::int16_t>(conversion_mode::saturating);
+    EXPECT_EQ(vec.data<std::int16_t>()[0], -1);
+    EXPECT_EQ(vec.data<std::int16_t>()[1], 32767);
+    EXPECT_EQ(vec.data<std::int16_t>()[2], 0);
+    EXPECT_EQ(vec.data<std::int16_t>()[3], 12);
+    EXPECT_EQ(vec.data<std::int16_t>()[4], -32768);
+
+    vec.convert<double, float>(conversion_mode::checked);
+    EXPECT_FLOAT_EQ(vec.data<float>()[1], 40000.0f);
+    EXPECT_TRUE(std::isnan(vec.data<float>()[2]));
+
+    // Infinities narrow to infinities in both modes; only finite values clamp
+    constexpr double inf = std::numeric_limits<double>::infinity();
+    auto wide = multi_vector<double, float>::builder().capacity<double>(3).capacity<float>(3).build();
+    for (double v : {inf, -inf, 1e300}) wide.push_back<double>(v);
+    EXPECT_THROW((wide.convert<double, float>(conversion_mode::checked)), std::range_error);
+    wide.clear<double>();
+    wide.push_back<double>(inf);
+    wide.push_back<double>(-inf);
+    wide.convert<double, float>(conversion_mode::checked);
+    const std::vector<float> checked(wide.begin<float>(), wide.end<float>());
+    wide.convert<double, float>(conversion_mode::saturating);
+    const std::vector<float> saturated(wide.begin<float>(), wide.end<float>());
+    EXPECT_EQ(checked, (std::vector<float>{std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()}));
+    EXPECT_EQ(saturated, checked);
+    wide.push_back<double>(1e300);
+    wide.convert<double, float>(conversion_mode::saturating);
+    EXPECT_EQ(wide.data<float>()[2], std::numeric_limits<float>::max());
+}
+
+TEST(MultiVector, ForEachBatch) {
+    MV vec = MV::builder()
+        .capacity<int>(10)
+        .capacity<double>(4)
+        .capacity<std::string>(1)
+        .build();
+    for (int i = 0; i < 10; ++i) vec.push_back<int>(i);
+    for (int i = 0; i < 4; ++i) vec.push_back<double>(i * 0.5);
+    vec.push_back<std::string>("s");
+
+    std::vector<std::size_t> int_sizes, double_sizes, string_sizes;
+    int int_sum = 0;
+    vec.for_each_batch(3, [&](column_span<int> ints, column_span<double> doubles, column_span<std::string> strings) {
+        int_sizes.push_back(ints.size());
+        double_sizes.push_back(doubles.size());
+        string_sizes.push_back(strings.size());
+        for (int& v : ints) {
+            int_sum += v;
+            v *= 2;
+        }
+    });
+    EXPECT_EQ(int_sizes, (std::vector<std::size_t>{3, 3, 3, 1}));
+    EXPECT_EQ(double_sizes, (std::vector<std::size_t>{3, 1, 0, 0}));
+    EXPECT_EQ(string_sizes, (std::vector<std::size_t>{1, 0, 0, 0}));
+    EXPECT_EQ(int_sum, 45);
+    EXPECT_EQ(vec.data<int>()[9], 18);
+
+    const MV& cvec = vec;
+    std::size_t batches = 0;
+    std::size_t rows = 0;
+    cvec.for_each_batch([&](column_span<const int> ints, column_span<const double>, column_span<const std::string>) {
+        ++batches;
+        rows += ints.size();
+    });
+    EXPECT_EQ(batches, 1u);  // 10 rows fit one default-sized batch
+    EXPECT_EQ(rows, 10u);
+    EXPECT_GE(MV::default_batch_rows(), 16u);
+}
+
+TEST(MultiVector, ClearKeepsBlock) {
+    Tracked::reset_counts();
+    {
+        auto vec = multi_vector<Tracked, int>::builder()
+            .capacity<Tracked>(2)
+            .capacity<int>(2)
+            .build();
+        vec.push_back<Tracked>(Tracked(1));
+        vec.push_back<int>(1);
+        const Tracked* block = vec.data<Tracked>();
+
+        vec.clear();
+        EXPECT_EQ(vec.size<Tracked>(), 0u);
+        EXPECT_EQ(vec.size<int>(), 0u);
+        EXPECT_EQ(Tracked::ctor_count, Tracked::dtor_count);
+        EXPECT_EQ(vec.data<Tracked>(), block);
+
+        vec.push_back<int>(2);
+        vec.push_back<Tracked>(Tracked(3));
+        vec.clear<int>();
+        EXPECT_EQ(vec.size<int>(), 0u);
+        EXPECT_EQ(vec.size<0>(), 1u);
+    }
+    EXPECT_EQ(Tracked::ctor_count, Tracked::dtor_count);
+}
+
+#if MULTI_VECTOR_HAS_COROUTINES
+namespace {
+
+// Source that hands out 0, 1, ..., limit - 1 without ever suspending
+struct counting_source {
+    int next_value = 0;
+    int limit = 0;
+
+    auto next() {
+        struct ready {
+            std::optional<int> value;
+            bool await_ready() const noexcept { return true; }
+            void await_suspend(std::coroutine_handle<>) const noexcept {}
+            std::optional<int> await_resume() { return std::move(value); }
+        };
+        return ready{next_value < limit ? std::optional<int>(next_value++) : std::nullopt};
+    }
+};
+
+} // namespace
+
+TEST(MultiVector, CoroutineBatchesAndFill) {
+    MV vec = MV::builder()
+        .capacity<int>(10)
+        .capacity<double>(0)
+        .capacity<std::string>(0)
+        .build();
+
+    counting_source source{0, 7};
+    EXPECT_EQ(multi_vector_coro::sync_wait(vec.fill_from<int>(source)), 7u);
+    source.limit = 100;
+    EXPECT_EQ(multi_vector_coro::sync_wait(vec.fill_from<0>(source)), 3u);  // stops when full
+    ASSERT_EQ(vec.size<int>(), 10u);
+    EXPECT_EQ(vec.data<int>()[9], 9);
+
+    std::vector<std::size_t> sizes;
+    for (const auto& batch : vec.batches(4)) {
+        sizes.push_back(std::get<0>(batch).size());
+        EXPECT_EQ(std::get<2>(batch).size(), 0u);
+    }
+    EXPECT_EQ(sizes, (std::vector<std::size_t>{4, 4, 2}));
+}
+
+TEST(MultiVector, CoroutineBatchPoolRecyclesInstances) {
+    using Pool = multi_vector_coro::batch_pool<int, double>;
+    auto b = multi_vector<int, double>::builder().capacity<int>(4).capacity<double>(4);
+    Pool pool(b, 1);
+
+    std::vector<int> seen;
+    std::thread::id resumed_on;
+    auto stage = [&](int id) -> multi_vector_coro::task<int> {
+        Pool::lease batch = co_await pool.acquire();
+        resumed_on = std::this_thread::get_id();
+        EXPECT_EQ(batch->size<int>(), 0u);  // recycled instances come back cleared
+        batch->push_back<int>(id);
+        seen.push_back(id);
+        co_return id;
+    };
+
+    {
+        multi_vector_coro::task<int> first = stage(1);
+        Pool::lease held = multi_vector_coro::sync_wait([&]() -> multi_vector_coro::task<Pool::lease> {
+            co_return co_await pool.acquire();
+        }());
+        EXPECT_EQ(pool.available(), 0u);
+        const int* block = held->data<int>();
+
+        // The stage parks in acquire() until the lease is returned, and is
+        // then resumed on this thread inside reset()
+        std::thread runner([&] { EXPECT_EQ(multi_vector_coro::sync_wait(std::move(first)), 1); });
+        while (pool.waiting() == 0) std::this_thread::yield();
+        EXPECT_TRUE(seen.empty());
+        held.reset();
+        EXPECT_EQ(resumed_on, std::this_thread::get_id());
+        runner.join();
+        EXPECT_EQ(pool.waiting(), 0u);
+        EXPECT_EQ(seen, std::vector<int>{1});
+        EXPECT_EQ(pool.available(), 1u);
+
+        EXPECT_EQ(multi_vector_coro::sync_wait(stage(2)), 2);
+        Pool::lease again = multi_vector_coro::sync_wait([&]() -> multi_vector_coro::task<Pool::lease> {
+            co_return co_await pool.acquire();
+        }());
+        EXPECT_EQ(again->data<int>(), block);
+    }
+}
+#endif
+
+TEST(MultiVector, DoubleBufferedHandoff) {
+    using DB = double_buffered_multi_vector<int, std::string>;
+    DB db(multi_vector<int, std::string>::builder().capacity<int>(64).capacity<std::string>(1));
+
+    {
+        auto front = db.read();
+        EXPECT_EQ(front->size<int>(), 0u);
+    }
+
+    auto& back = db.acquire_back();
+    back.push_back<int>(1);
+    back.push_back<std::string>("first");
+    const int* first_block = back.data<int>();
+    db.publish();
+    {
+        auto front = db.read();
+        ASSERT_EQ(front->size<int>(), 1u);
+        EXPECT_EQ((*front).data<std::string>()[0], "first");
+    }
+
+    // Two publishes later the first buffer comes back cleared, same block
+    db.acquire_back().push_back<int>(2);
+    db.publish();
+    auto& reused = db.acquire_back();
+    EXPECT_EQ(reused.size<int>(), 0u);
+    EXPECT_EQ(reused.data<int>(), first_block);
+    EXPECT_EQ(&db.back(), &reused);
+
+    // Concurrent readers only ever see complete generations
+    std::atomic<bool> stop{false};
+    std::atomic<int> torn{0};
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; ++r) {
+        readers.emplace_back([&] {
+            while (!stop.load()) {
+                auto front = db.read();
+                const int* p = front->data<int>();
+                for (std::size_t i = 1; i < front->size<int>(); ++i) {
+                    if (p[i] != p[0]) torn.fetch_add(1);
+                }
+            }
+        });
+    }
+    for (int gen = 0; gen < 500; ++gen) {
+        auto& buf = db.acquire_back();
+        for (int i = 0; i < 64; ++i) buf.push_back<int>(gen);
+        db.publish();
+    }
+    stop = true;
+    for (auto& t : readers) t.join();
+    EXPECT_EQ(torn.load(), 0);
+    EXPECT_EQ(db.read()->data<int>()[63], 499);
+}
+
+TEST(MultiVector, AppendOnlyPublishesToReaders) {
+    using AO = append_only_multi_vector<int, std::string>;
+    AO ao(multi_vector<int, std::string>::builder()
+        .capacity<int>(20000)
+        .capacity<std::string>(4)
+        .default_value<std::string>("d"));
+
+    auto empty = ao.snapshot();
+    EXPECT_EQ(empty.size<int>(), 0u);
+    EXPECT_EQ(empty.size<1>(), 4u);  // defaults are published up front
+
+    std::atomic<bool> done{false};
+    std::atomic<int> bad{0};
+    std::thread reader([&] {
+        std::size_t last = 0;
+        while (!done.load()) {
+            auto snap = ao.snapshot();
+            auto ints = snap.column<int>();
+            if (ints.size() < last) bad.fetch_add(1);
+            for (std::size_t i = last; i < ints.size(); ++i) {
+                if (ints[i] != static_cast<int>(i)) bad.fetch_add(1);
+            }
+            last = ints.size();
+        }
+    });
+
+    for (int i = 0; i < 10000; ++i) ao.push_back<int>(i);
+    std::vector<int> tail(10000);
+    for (int i = 0; i < 10000; ++i) tail[i] = 10000 + i;
+    ao.append<int>(column_span<const int>(tail.data(), tail.size()));
+    done = true;
+    reader.join();
+
+    EXPECT_EQ(bad.load(), 0);
+    EXPECT_EQ(ao.published_size<int>(), 20000u);
+    EXPECT_THROW(ao.push_back<int>(0), std::length_error);
+    const std::string extra[1] = {"x"};
+    EXPECT_THROW(ao.append<1>(column_span<const std::string>(extra, 1)), std::length_error);
+    EXPECT_EQ(ao.snapshot().column<1>()[3], "d");
+}
+
+TEST(MultiVector, AppendOnlyParallelClaims) {
+    using AO = append_only_multi_vector<std::uint64_t, std::string>;
+    constexpr std::size_t writers = 4;
+    constexpr std::size_t chunk = 250;
+    constexpr std::size_t total = 1 + writers * 64 * chunk;
+    AO ao(multi_vector<std::uint64_t, std::string>::builder()
+        .capacity<std::uint64_t>(total + 8)
+        .capacity<std::string>(1));
+    ao.push_back<std::uint64_t>(0);
+
+    std::atomic<bool> done{false};
+    std::atomic<int> bad{0};
+    std::thread reader([&] {
+        while (!done.load()) {
+            auto col = ao.snapshot().column<std::uint64_t>();
+            for (std::size_t i = 0; i < col.size(); ++i) {
+                if (col[i] != i) bad.fetch_add(1);
+            }
+        }
+    });
+
+    std::vector<std::thread> threads;
+    for (std::size_t w = 0; w < writers; ++w) {
+        threads.emplace_back([&] {
+            for (int k = 0; k < 64; ++k) {
+                auto r = ao.claim_range<std::uint64_t>(chunk);
+                auto slots = ao.slots<0>(r);
+                for (std::size_t j = 0; j < slots.size(); ++j) slots[j] = r.begin + j;
+                ao.commit_range<0>(r);
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    done = true;
+    reader.join();
+    EXPECT_EQ(bad.load(), 0);
+    EXPECT_EQ(ao.published_size<std::uint64_t>(), total);
+
+    // Claims interleave with single-writer appends on the same column
+    auto mine = ao.claim<std::uint64_t>(4);
+    for (auto& v : mine) v = 7;
+    ao.commit(mine);
+    ao.push_back<std::uint64_t>(8);
+    EXPECT_EQ(ao.published_size<std::uint64_t>(), total + 5);
+    EXPECT_EQ(ao.snapshot().column<0>()[total + 4], 8u);
+    EXPECT_THROW(ao.claim<std::uint64_t>(4), std::length_error);
+    EXPECT_EQ(ao.claim<std::uint64_t>(3).size(), 3u);
+
+    // Racing claims past the capacity roll back without losing or sharing slots
+    constexpr std::size_t small_cap = 1000;
+    append_only_multi_vector<std::uint32_t> racy(multi_vector<std::uint32_t>::builder().capacity<0>(small_cap));
+    std::vector<std::vector<std::pair<std::size_t, std::size_t>>> won(writers);
+    threads.clear();
+    for (std::size_t w = 0; w < writers; ++w) {
+        threads.emplace_back([&, w] {
+            for (std::size_t k = 1; k < 400; ++k) {
+                try {
+                    auto r = racy.claim_range<0>(k % 13 + 1);
+                    won[w].emplace_back(r.begin, r.end);
+                } catch (const std::length_error&) {
+                }
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    std::vector<int> owners(small_cap, 0);
+    std::size_t claimed = 0;
+    for (const auto& ranges : won) {
+        for (auto [b, e] : ranges) {
+            ASSERT_LE(e, small_cap);
+            for (std::size_t i = b; i < e; ++i) ++owners[i];
+            claimed += e - b;
+        }
+    }
+    for (std::size_t i = 0; i < claimed; ++i) EXPECT_EQ(owners[i], 1) << i;
+    if (claimed < small_cap) {
+        EXPECT_EQ(racy.claim_range<0>(1).begin, claimed);
+    } else {
+        EXPECT_THROW(racy.claim_range<0>(1), std::length_error);
+    }
+}
+
+TEST(MultiVector, RcuPublishAndReclaim) {
+    Tracked::reset_counts();
+    {
+        using RCU = rcu_multi_vector<Tracked>;
+        auto make = [](int v) {
+            auto mv = multi_vector<Tracked>::builder().capacity<Tracked>(1).build();
+            mv.push_back<Tracked>(Tracked(v));
+            return mv;
+        };
+        RCU rcu(make(1));
+
+        {
+            auto guard = rcu.read();
+            auto nested = rcu.read();
+            rcu.publish(make(2));
+            // The old instance is pinned by this thread's read section
+            EXPECT_EQ(guard->data<Tracked>()[0], 1);
+            EXPECT_EQ(rcu.reclaim(), 1u);
+            EXPECT_EQ(nested->data<Tracked>()[0], 1);
+        }
+        EXPECT_EQ(rcu.reclaim(), 0u);
+        EXPECT_EQ(rcu.read()->data<Tracked>()[0], 2);
+
+        // Readers on other threads always see a complete, live instance
+        std::atomic<bool> stop{false};
+        std::atomic<int> bad{0};
+        std::vector<std::thread> readers;
+        for (int r = 0; r < 3; ++r) {
+            readers.emplace_back([&] {
+                while (!stop.load()) {
+                    auto g = rcu.read();
+                    if (g->size<Tracked>() != 1 || g->data<Tracked>()[0].value < 2) bad.fetch_add(1);
+                }
+            });
+        }
+        for (int v = 3; v < 200; ++v) rcu.publish(make(v));
+        stop = true;
+        for (auto& t : readers) t.join();
+        rcu.synchronize();
+        EXPECT_EQ(bad.load(), 0);
+        EXPECT_EQ(rcu.read()->data<Tracked>()[0], 199);
+    }
+    EXPECT_EQ(Tracked::ctor_count, Tracked::dtor_count);
+}
+
+TEST(MultiVector, SnapshotCopyOnWrite) {
+    Tracked::reset_counts();
+    {
+        auto vec = multi_vector<int, Tracked>::builder()
+            .capacity<int>(4)
+            .capacity<Tracked>(4)
+            .build();
+        vec.push_back<int>(1);
+        vec.push_back<int>(2);
+        vec.push_back<Tracked>(Tracked(10));
+        const int* ints = std::as_const(vec).data<int>();
+        const Tracked* tracked = std::as_const(vec).data<Tracked>();
+
+        auto snap = vec.snapshot();
+        EXPECT_EQ(snap.data<int>(), ints);
+        EXPECT_EQ(snap.data<Tracked>(), tracked);
+
+        // Writing one column detaches it alone
+        vec.push_back<int>(3);
+        EXPECT_NE(std::as_const(vec).data<int>(), ints);
+        EXPECT_EQ(std::as_const(vec).data<Tracked>(), tracked);
+        EXPECT_EQ(vec.size<int>(), 3u);
+        EXPECT_EQ(vec.capacity<int>(), 4u);
+        EXPECT_EQ(snap.size<int>(), 2u);
+        EXPECT_EQ(snap.column<int>()[1], 2);
+
+        auto copy = snap;
+        vec.clear<Tracked>();
+        EXPECT_EQ(vec.size<Tracked>(), 0u);
+        EXPECT_EQ(copy.size<Tracked>(), 1u);
+        EXPECT_EQ(copy.column<Tracked>()[0], 10);
+
+        // Snapshots outlive the instance
+        { auto gone = std::move(vec); }
+        EXPECT_EQ(snap.column<int>()[0], 1);
+        EXPECT_EQ(copy.data<Tracked>(), tracked);
+    }
+    EXPECT_EQ(Tracked::ctor_count, Tracked::dtor_count);
+}
+
+TEST(MultiVector, ShardedMergeConcatenatesShards) {
+    using Sharded = sharded_multi_vector<int, std::string, double>;
+    Sharded sharded(multi_vector<int, std::string, double>::builder()
+        .capacity<int>(1000)
+        .capacity<std::string>(1000)
+        .capacity<double>(10));
+
+    std::vector<std::thread> workers;
+    for (int w = 0; w < 4; ++w) {
+        workers.emplace_back([&sharded, w] {
+            auto& shard = sharded.local();
+            EXPECT_EQ(&sharded.local(), &shard);
+            for (int i = 0; i < 1000; ++i) {
+                shard.push_back<int>(w * 1000 + i);
+                if (i % 10 == 0) shard.push_back<std::string>(std::to_string(w * 1000 + i));
+            }
+        });
+    }
+    for (auto& t : workers) t.join();
+    EXPECT_EQ(sharded.shard_count(), 4u);
+    EXPECT_EQ(sharded.size<int>(), 4000u);
+    EXPECT_EQ(sharded.size<1>(), 400u);
+
+    for (std::size_t threads : {std::size_t{1}, std::size_t{0}}) {
+        auto merged = sharded.merge(threads);
+        EXPECT_EQ(merged.size<int>(), 4000u);
+        EXPECT_EQ(merged.capacity<int>(), 4000u);
+        EXPECT_EQ(merged.size<std::string>(), 400u);
+        EXPECT_EQ(merged.size<double>(), 0u);
+
+        std::vector<int> ints(merged.begin<int>(), merged.end<int>());
+        std::sort(ints.begin(), ints.end());
+        for (int i = 0; i < 4000; ++i) EXPECT_EQ(ints[i], i);
+        // Shards are concatenated whole, so each run stays in order
+        for (std::size_t i = 0; i < 4000; i += 1000) {
+            EXPECT_TRUE(std::is_sorted(merged.begin<int>() + i, merged.begin<int>() + i + 1000));
+            EXPECT_EQ(std::to_string(merged.data<int>()[i]), merged.data<std::string>()[i / 10]);
+        }
+    }
+
+    sharded.clear();
+    EXPECT_EQ(sharded.size<int>(), 0u);
+    sharded.local().push_back<double>(1.5);
+    EXPECT_EQ(sharded.merge().data<double>()[0], 1.5);
+
+    // A wrapped circular shard is merged oldest first
+    sharded_multi_vector<int, std::string> ring_shards(multi_vector<int, std::string>::builder()
+        .capacity<int>(4)
+        .capacity<std::string>(4)
+        .circular<int>()
+        .circular<std::string>());
+    for (int i = 0; i < 6; ++i) {
+        ring_shards.local().push_back<int>(i);
+        ring_shards.local().push_back<std::string>(std::to_string(i));
+    }
+    std::thread([&] { ring_shards.local().push_back<int>(9); ring_shards.local().push_back<std::string>("9"); }).join();
+    auto rings = ring_shards.merge();
+    EXPECT_EQ(std::vector<int>(rings.begin<int>(), rings.end<int>()), (std::vector<int>{2, 3, 4, 5, 9}));
+    EXPECT_EQ(std::vector<std::string>(rings.begin<std::string>(), rings.end<std::string>()),
+              (std::vector<std::string>{"2", "3", "4", "5", "9"}));
+
+    // The merged instance is torn down the way the shard builder asks
+    block_reclaimer reclaimer(4);
+    std::atomic<bool> release{false};
+    std::atomic<bool> started{false};
+    struct gate {
+        std::atomic<bool>& started;
+        std::atomic<bool>& release;
+    } g{started, release};
+    reclaimer.retire([](void* p) {
+        auto* g = static_cast<gate*>(p);
+        g->started = true;
+        while (!g->release.load()) std::this_thread::yield();
+    }, &g);
+    while (!started.load()) std::this_thread::yield();
+    sharded_multi_vector<int> reclaimed(multi_vector<int>::builder()
+        .capacity<int>(8)
+        .parallel_destroy()
+        .reclaim_with(reclaimer));
+    reclaimed.local().push_back<int>(1);
+    {
+        auto merged = reclaimed.merge();
+        EXPECT_EQ(merged.data<int>()[0], 1);
+    }
+    EXPECT_EQ(reclaimer.pending(), 2u);
+    release = true;
+    reclaimer.flush();
+}
+
+TEST(MultiVector, AtomicCounterColumns) {
+    using Padded = atomic_counter<std::uint64_t>;
+    using Sharded = atomic_counter<std::uint64_t, 4>;
+    static_assert(sizeof(Padded) == 64 && alignof(Padded) == 64, "one counter per cache line");
+    static_assert(sizeof(Sharded) == 4 * 64, "one cache line per shard");
+
+    auto vec = multi_vector<Padded, Sharded, int>::builder()
+        .capacity<Padded>(8)
+        .capacity<Sharded>(2)
+        .default_value<Padded>(Padded(0))
+        .default_value<Sharded>(Sharded(10))
+        .build();
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(vec.data<Padded>()) % 64, 0u);
+
+    constexpr int threads = 4;
+    constexpr int iterations = 20000;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&vec, t] {
+            for (int k = 0; k < iterations; ++k) {
+                vec.fetch_add<Padded>(static_cast<std::size_t>(k % 8), 1);
+                vec.fetch_add<1>(static_cast<std::size_t>(t % 2), 2);
+            }
+        });
+    }
+    for (auto& w : workers) w.join();
+
+    EXPECT_EQ(vec.counter_total<Padded>(), std::uint64_t{threads * iterations});
+    EXPECT_EQ(vec.counter_value<Padded>(3), std::uint64_t{threads * iterations / 8});
+    EXPECT_EQ(vec.counter_value<Sharded>(0), 10 + std::uint64_t{2 * iterations * threads / 2});
+    EXPECT_EQ(vec.counter_total<1>(), 20 + std::uint64_t{2 * iterations * threads});
+
+    Sharded copy(vec.data<Sharded>()[1]);
+    EXPECT_EQ(copy.load(), vec.counter_value<Sharded>(1));
+    copy.store(5);
+    EXPECT_EQ(copy.load(), 5u);
+}
+
+TEST(MultiVector, SpscRingPassesRowsInOrder) {
+    Tracked::reset_counts();
+    {
+        using Ring = spsc_ring_multi_vector<int, Tracked>;
+        Ring small(multi_vector<int, Tracked>::builder().capacity<int>(5).capacity<Tracked>(2));
+        EXPECT_EQ(small.capacity(), 8u);
+        for (int i = 0; i < 8; ++i) EXPECT_TRUE(small.try_push(i, Tracked(i)));
+        EXPECT_FALSE(small.try_push(8, Tracked(8)));
+        int id = -1;
+        Tracked t;
+        EXPECT_TRUE(small.try_pop(id, t));
+        EXPECT_EQ(id, 0);
+        EXPECT_EQ(t.value, 0);
+        EXPECT_EQ(small.size(), 7u);
+        int ids[2];
+        Tracked ts[2];
+        EXPECT_THROW(small.pop_n(column_span<int>(ids, 2), column_span<Tracked>(ts, 1)), std::invalid_argument);
+        // The remaining rows are destroyed with the ring
+    }
+    EXPECT_EQ(Tracked::ctor_count, Tracked::dtor_count);
+
+    using Ring = spsc_ring_multi_vector<std::uint64_t, std::string>;
+    Ring ring(multi_vector<std::uint64_t, std::string>::builder().capacity<std::uint64_t>(64));
+    constexpr std::uint64_t total = 100000;
+    std::thread producer([&] {
+        std::vector<std::uint64_t> ids(37);
+        std::vector<std::string> names(37);
+        std::uint64_t next = 0;
+        while (next < total) {
+            const std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(1 + next % 37, total - next));
+            for (std::size_t j = 0; j < n; ++j) {
+                ids[j] = next + j;
+                names[j] = std::to_string(next + j);
+            }
+            std::size_t sent = 0;
+            while (sent < n) {
+                const std::size_t k = ring.push_n(column_span<const std::uint64_t>(ids.data() + sent, n - sent),
+                                                  column_span<const std::string>(names.data() + sent, n - sent));
+                if (k == 0) std::this_thread::yield();
+                sent += k;
+            }
+            next += n;
+        }
+    });
+
+    std::vector<std::uint64_t> ids(50);
+    std::vector<std::string> names(50);
+    std::uint64_t expected = 0;
+    bool ordered = true;
+    while (expected < total) {
+        const std::size_t got = ring.pop_n(column_span<std::uint64_t>(ids), column_span<std::string>(names));
+        if (got == 0) std::this_thread::yield();
+        for (std::size_t j = 0; j < got; ++j, ++expected) {
+            ordered = ordered && ids[j] == expected && names[j] == std::to_string(expected);
+        }
+    }
+    producer.join();
+    EXPECT_TRUE(ordered);
+    EXPECT_TRUE(ring.empty());
+}
+
+TEST(MultiVector, CircularColumnsKeepLastValues) {
+    auto vec = multi_vector<int, std::string>::builder()
+        .capacity<int>(4)
+        .capacity<std::string>(2)
+        .circular<int>()
+        .build();
+    for (int i = 0; i < 3; ++i) vec.push_back<int>(i);
+    auto segs = vec.segments<int>();
+    EXPECT_EQ(segs[0].size(), 3u);
+    EXPECT_TRUE(segs[1].empty());
+
+    for (int i = 3; i < 10; ++i) vec.push_back<int>(i);
+    EXPECT_EQ(vec.size<int>(), 4u);
+    segs = vec.segments<int>();
+    std::vector<int> logical;
+    for (const auto& seg : segs) logical.insert(logical.end(), seg.begin(), seg.end());
+    EXPECT_EQ(logical, (std::vector<int>{6, 7, 8, 9}));
+    EXPECT_EQ(segs[0].size(), 2u);
+
+    // Order-independent kernels run on the whole column
+    EXPECT_EQ(vec.col<int>().sum(), 30);
+    EXPECT_EQ(vec.histogram<int>(0, 10, 2), (std::vector<std::size_t>{0, 4}));
+
+    vec.linearize<int>();
+    EXPECT_EQ(std::vector<int>(vec.begin<int>(), vec.end<int>()), logical);
+    EXPECT_TRUE(vec.segments<int>()[1].empty());
+
+    // Columns that are not circular still refuse to grow
+    vec.push_back<std::string>("a");
+    vec.push_back<std::string>("b");
+    EXPECT_THROW(vec.push_back<std::string>("c"), std::length_error);
+
+    vec.clear<int>();
+    vec.push_back<int>(1);
+    EXPECT_EQ(vec.segments<0>()[0].size(), 1u);
+
+    // Types that can be copied but not assigned are destroyed and rebuilt
+    struct Reading {
+        const int sensor;
+        double value;
+    };
+    static_assert(!std::is_copy_assignable_v<Reading>);
+    auto readings = multi_vector<Reading>::builder().capacity<Reading>(2).circular<Reading>().build();
+    for (int i = 0; i < 5; ++i) readings.push_back(Reading{i, i * 1.5});
+    EXPECT_EQ(readings.size<Reading>(), 2u);
+    const auto oldest_first = readings.segments<Reading>();
+    EXPECT_EQ(oldest_first[0][0].sensor, 3);
+    EXPECT_EQ(oldest_first[1][0].sensor, 4);
+    EXPECT_EQ(oldest_first[1][0].value, 6.0);
+}
+
+namespace {
+
+struct counting_executor final : executor {
+    std::atomic<int> calls{0};
+
+    std::size_t concurrency() const noexcept override { return 2; }
+
+    void bulk(std::size_t n, void (*fn)(void*, std::size_t), void* ctx) override {
+        calls.fetch_add(1);
+        for (std::size_t i = 0; i < n; ++i) fn(ctx, i);
+    }
+};
+
+} // namespace
+
+TEST(MultiVector, WorkStealingPool) {
+    work_stealing_pool pool(4);
+    EXPECT_EQ(pool.concurrency(), 4u);
+
+    std::vector<int> hits(100000, 0);
+    parallel_for(pool, 0, hits.size(), 1000, [&](std::size_t lo, std::size_t hi) {
+        for (std::size_t i = lo; i < hi; ++i) ++hits[i];
+    });
+    EXPECT_EQ(std::count(hits.begin(), hits.end(), 1), 100000);
+
+    // Nested fork/join from inside pool tasks
+    std::atomic<std::size_t> total{0};
+    parallel_for(pool, 0, 16, 1, [&](std::size_t, std::size_t) {
+        parallel_for(pool, 0, 100, 7, [&](std::size_t lo, std::size_t hi) { total.fetch_add(hi - lo); });
+    });
+    EXPECT_EQ(total.load(), 1600u);
+
+    int a = 0;
+    int b = 0;
+    parallel_invoke(pool, [&] { a = 1; }, [&] { b = 2; });
+    EXPECT_EQ(a + b, 3);
+
+    EXPECT_THROW(parallel_for(pool, 0, 64, 1, [](std::size_t lo, std::size_t) {
+        if (lo == 33) throw std::runtime_error("boom");
+    }), std::runtime_error);
+
+    // Kernels run on whatever executor is installed
+    counting_executor custom;
+    set_default_executor(&custom);
+    auto vec = multi_vector<int>::builder().capacity<int>(4096).build();
+    for (int i = 0; i < 4096; ++i) vec.push_back<int>(i % 8);
+    auto counts = vec.parallel_histogram<int>(0, 8, 8);
+    set_default_executor(nullptr);
+    EXPECT_EQ(custom.calls.load(), 1);
+    EXPECT_EQ(counts, std::vector<std::size_t>(8, 512));
+    EXPECT_EQ(vec.parallel_histogram<int>(0, 8, 8, 3), counts);
+
+    // Or on one passed explicitly, leaving the default alone
+    counting_executor passed;
+    EXPECT_EQ(vec.parallel_histogram<int>(0, 8, 8, passed), counts);
+    EXPECT_EQ(vec.parallel_histogram<0>(std::vector<int>{0, 4, 8}, passed, 2),
+              (std::vector<std::size_t>{2048, 2048}));
+    EXPECT_EQ(passed.calls.load(), 2);
+
+    sharded_multi_vector<int> sharded(multi_vector<int>::builder().capacity<int>(8));
+    sharded.local().push_back<int>(7);
+    EXPECT_EQ(sharded.merge(passed).data<int>()[0], 7);
+    EXPECT_EQ(passed.calls.load(), 3);
+    EXPECT_EQ(custom.calls.load(), 1);
+}
+
+namespace {
+
+// Tracked's counters are not thread-safe; this one is destroyed in parallel
+struct Counted {
+    static std::atomic<int> live;
+
+    Counted() { live.fetch_add(1); }
+    Counted(const Counted&) { live.fetch_add(1); }
+    Counted& operator=(const Counted&) = default;
+    ~Counted() { live.fetch_sub(1); }
+};
+
+std::atomic<int> Counted::live{0};
+
+} // namespace
+
+TEST(MultiVector, ParallelAndAsyncDestroy) {
+    constexpr std::size_t rows = 100000;
+    auto fill = [](multi_vector<Counted, int>& vec) {
+        for (std::size_t i = 0; i < rows; ++i) vec.push_back<Counted>(Counted());
+    };
+
+    {
+        auto vec = multi_vector<Counted, int>::builder()
+            .capacity<Counted>(rows)
+            .parallel_destroy(4)
+            .build();
+        fill(vec);
+        EXPECT_EQ(Counted::live.load(), static_cast<int>(rows));
+        vec.clear();
+        EXPECT_EQ(Counted::live.load(), 0);
+        fill(vec);
+    }
+    EXPECT_EQ(Counted::live.load(), 0);
+
+    {
+        work_stealing_pool pool(2);
+        auto vec = multi_vector<Counted, int>::builder().capacity<Counted>(rows).build();
+        fill(vec);
+        vec.destroy_async(pool);
+        EXPECT_EQ(vec.size<Counted>(), 0u);
+        EXPECT_EQ(vec.capacity<Counted>(), 0u);
+        vec.destroy_async(pool);  // nothing left to hand off
+        // The pool finishes posted work before it goes away
+    }
+    EXPECT_EQ(Counted::live.load(), 0);
+
+    // An executor that fails part way must not terminate the destructor;
+    // the chunks it never ran are destroyed serially, each exactly once
+    struct failing_executor final : executor {
+        std::size_t concurrency() const noexcept override { return 4; }
+        void bulk(std::size_t n, void (*fn)(void*, std::size_t), void* ctx) override {
+            for (std::size_t i = 0; i < n / 2; ++i) fn(ctx, i);
+            throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again));
+        }
+    } failing;
+    set_default_executor(&failing);
+    {
+        auto vec = multi_vector<Counted>::builder().capacity<Counted>(rows).parallel_destroy().build();
+        for (std::size_t i = 0; i < rows; ++i) vec.push_back(Counted());
+    }
+    set_default_executor(nullptr);
+    EXPECT_EQ(Counted::live.load(), 0);
+}
+
+TEST(MultiVector, BlockReclaimerFreesInBackground) {
+    Tracked::reset_counts();
+    {
+        block_reclaimer reclaimer(2);
+
+        // Occupy the reclaimer thread, then fill its queue
+        struct gate {
+            std::atomic<bool> started{false};
+            std::atomic<bool> release{false};
+            std::atomic<int> freed{0};
+        } g;
+        auto wait_then_count = [](void* p) {
+            auto* g = static_cast<gate*>(p);
+            g->started = true;
+            while (!g->release.load()) std::this_thread::yield();
+            g->freed.fetch_add(1);
+        };
+        auto count = [](void* p) { static_cast<gate*>(p)->freed.fetch_add(1); };
+        reclaimer.retire(wait_then_count, &g);
+        while (!g.started.load()) std::this_thread::yield();
+        // The blocking item is being run, not queued, so two more fit
+        reclaimer.retire(count, &g);
+        reclaimer.retire(count, &g);
+        EXPECT_EQ(reclaimer.freed_inline(), 0u);
+        EXPECT_EQ(reclaimer.pending(), 3u);
+        reclaimer.retire(count, &g);  // queue full: runs right here
+        EXPECT_EQ(reclaimer.freed_inline(), 1u);
+        EXPECT_EQ(g.freed.load(), 1);
+        g.release = true;
+        reclaimer.flush();
+        EXPECT_EQ(g.freed.load(), 4);
+        EXPECT_EQ(reclaimer.pending(), 0u);
+
+        // Instances destroy their elements, then hand the block over
+        {
+            auto vec = multi_vector<Tracked, int>::builder()
+                .capacity<Tracked>(8)
+                .reclaim_with(reclaimer)
+                .build();
+            vec.push_back<Tracked>(Tracked(1));
+        }
+        EXPECT_EQ(Tracked::ctor_count, Tracked::dtor_count);
+
+        auto other = multi_vector<Tracked>::builder().capacity<Tracked>(4).build();
+        other.push_back<Tracked>(Tracked(2));
+        reclaimer.retire(std::move(other));
+        reclaimer.flush();
+        EXPECT_EQ(Tracked::ctor_count, Tracked::dtor_count);
+
+        // Storage shared with a snapshot goes to the reclaimer too, whichever
+        // holder lets go of it last
+        g.started = false;
+        g.release = false;
+        reclaimer.retire(wait_then_count, &g);
+        while (!g.started.load()) std::this_thread::yield();
+        {
+            auto vec = multi_vector<int>::builder()
+                .capacity<int>(8)
+                .reclaim_with(reclaimer)
+                .build();
+            vec.push_back<int>(1);
+            auto snap = vec.snapshot();
+            EXPECT_EQ(snap.column<int>()[0], 1);
+        }
+        EXPECT_EQ(reclaimer.pending(), 2u);
+        EXPECT_EQ(reclaimer.freed_inline(), 1u);
+        g.release = true;
+        reclaimer.flush();
+        EXPECT_EQ(reclaimer.pending(), 0u);
+    }
+}
+
+TEST(MultiVector, MemoryBudget) {
+    memory_budget budget(4096);
+    auto small = multi_vector<int, double>::builder()
+        .capacity<int>(100)
+        .capacity<double>(100)
+        .budget(budget)
+        .build();
+    const std::size_t small_bytes = budget.usage();
+    EXPECT_GE(small_bytes, 1200u);
+
+    // Fails fast without a pressure handler
+    auto too_big = multi_vector<int>::builder().capacity<int>(1024).budget(budget);
+    EXPECT_THROW(too_big.build(), std::bad_alloc);
+    EXPECT_EQ(budget.usage(), small_bytes);
+
+    // Shrinking returns the slack
+    for (int i = 0; i < 10; ++i) small.push_back<int>(i);
+    small.shrink_to_fit();
+    EXPECT_EQ(small.capacity<int>(), 10u);
+    EXPECT_EQ(small.capacity<double>(), 0u);
+    EXPECT_EQ(small.data<int>()[9], 9);
+    EXPECT_LT(budget.usage(), small_bytes);
+
+    // Copy-on-write copies are charged too
+    {
+        auto snap = small.snapshot();
+        const std::size_t before = budget.usage();
+        small.clear<int>();
+        EXPECT_EQ(budget.usage(), before + 10 * sizeof(int));
+    }
+    EXPECT_GE(budget.peak(), small_bytes);
+
+    // A pressure handler can make room and ask for a retry
+    memory_budget* seen = nullptr;
+    int calls = 0;
+    std::optional<multi_vector<int>> cold;
+    memory_budget pressured(4096, [&](memory_budget& b, std::size_t requested) {
+        ++calls;
+        seen = &b;
+        EXPECT_EQ(requested, 512 * sizeof(int));
+        if (!cold) return false;
+        cold.reset();
+        return true;
+    });
+    cold.emplace(multi_vector<int>::builder().capacity<int>(600).budget(pressured).build());
+    auto first = multi_vector<int>::builder().capacity<int>(512).budget(pressured).build();
+    EXPECT_EQ(calls, 1);
+    EXPECT_FALSE(cold.has_value());
+    auto second = multi_vector<int>::builder().capacity<int>(512).budget(pressured).build();
+    EXPECT_EQ(pressured.usage(), 4096u);
+    EXPECT_THROW(multi_vector<int>::builder().capacity<int>(512).budget(pressured).build(), std::bad_alloc);
+    EXPECT_EQ(calls, 2);
+    EXPECT_EQ(seen, &pressured);
+    EXPECT_EQ(pressured.peak(), 4096u);
+
+    // The handler may shrink instances that draw from the same budget
+    int shrink_calls = 0;
+    std::optional<multi_vector<int>> roomy;
+    memory_budget shrinking(4096, [&](memory_budget&, std::size_t) {
+        ++shrink_calls;
+        roomy->shrink_to_fit();
+        return shrink_calls < 2;
+    });
+    roomy.emplace(multi_vector<int>::builder().capacity<int>(1024).budget(shrinking).build());
+    for (int i = 0; i < 16; ++i) roomy->push_back<int>(i);
+    EXPECT_EQ(shrinking.usage(), 4096u);
+    auto fits = multi_vector<int>::builder().capacity<int>(256).budget(shrinking).build();
+    EXPECT_EQ(shrink_calls, 1);
+    EXPECT_EQ(roomy->capacity<int>(), 16u);
+    EXPECT_EQ(roomy->data<int>()[15], 15);
+    EXPECT_EQ(shrinking.usage(), 272 * sizeof(int));
+    EXPECT_EQ(shrinking.peak(), 4096u);
+    EXPECT_THROW(multi_vector<int>::builder().capacity<int>(1024).budget(shrinking).build(), std::bad_alloc);
+    EXPECT_EQ(shrink_calls, 2);
+
+    // A request from inside the handler fails instead of re-entering it
+    int nested_calls = 0;
+    memory_budget nested(64, [&](memory_budget& b, std::size_t) {
+        ++nested_calls;
+        EXPECT_THROW(b.acquire(128), std::bad_alloc);
+        return false;
+    });
+    EXPECT_THROW(nested.acquire(128), std::bad_alloc);
+    EXPECT_EQ(nested_calls, 1);
+    EXPECT_EQ(nested.usage(), 0u);
+
+    // Wrappers that lay out their own instances keep the builder's budget
+    memory_budget wrapped(1 << 20);
+    auto ints = multi_vector<int>::builder().capacity<int>(100).budget(wrapped);
+    {
+        sharded_multi_vector<int> sharded(ints);
+        for (int i = 0; i < 100; ++i) sharded.local().push_back<int>(i);
+        const std::size_t shards = wrapped.usage();
+        auto merged = sharded.merge(1);
+        EXPECT_EQ(wrapped.usage(), shards + 100 * sizeof(int));
+    }
+    EXPECT_EQ(wrapped.usage(), 0u);
+    {
+        spsc_ring_multi_vector<int> ring(ints);
+        EXPECT_EQ(wrapped.usage(), 128 * sizeof(int));
+    }
+    EXPECT_EQ(wrapped.usage(), 0u);
+}
+
+TEST(MultiVector, OperationCounters) {
+    static_assert(!multi_vector<int>::counting, "counters are off by default");
+    static_assert(std::is_empty_v<multi_vector_detail::op_recorder<no_op_counters, 3>>, "disabled counters add no state");
+
+    using Instrumented = basic_multi_vector<op_counters<true>, int, double>;
+    auto mv = Instrumented::builder().capacity<int>(4).capacity<double>(2).build();
+    for (int i = 0; i < 3; ++i) mv.push_back<int>(i);
+    mv.push_back<double>(1.0);
+    mv.push_back<double>(2.0);
+    EXPECT_THROW(mv.push_back<double>(3.0), std::length_error);
+    {
+        auto snap = mv.snapshot();
+        mv.data<int>()[0] = 7;  // copies the three ints
+    }
+    mv.shrink_to_fit();  // moves three ints and two doubles
+
+    Instrumented moved = std::move(mv);
+    const auto s = moved.stats();
+    EXPECT_EQ(s.pushes, (std::array<std::size_t, 2>{3, 2}));
+    EXPECT_EQ(s.failures, (std::array<std::size_t, 2>{0, 1}));
+    EXPECT_EQ(s.peak_sizes, (std::array<std::size_t, 2>{3, 2}));
+    EXPECT_EQ(s.reallocations, 2u);
+    EXPECT_EQ(s.bytes_moved, 6 * sizeof(int) + 2 * sizeof(double));
+
+    auto plain = basic_multi_vector<op_counters<>, int>::builder().capacity<int>(8).default_value<int>(0).build();
+    plain.clear();
+    plain.push_back<int>(1);
+    EXPECT_EQ(plain.stats().pushes[0], 1u);
+    EXPECT_EQ(plain.stats().peak_sizes[0], 8u);
+    EXPECT_EQ(multi_vector<int>().stats().pushes[0], 0u);
+}
+
+template <std::size_t I>
+struct wide_column {
+    int value;
+};
+
+template <std::size_t... Is>
+multi_vector<wide_column<Is>...> make_wide(std::index_sequence<Is...>);
+
+TEST(MultiVector, TypeLookupScalesToWideSchemas) {
+    static_assert(multi_vector_detail::index_of<double, int, double, char>() == 1);
+    static_assert(multi_vector_detail::index_of<float, int, double, char>() == 3, "missing type");
+    static_assert(multi_vector_detail::index_of<int, char, int, int>() == 1, "first of a repeated type");
+    static_assert(std::is_same_v<multi_vector_detail::type_at<2, int, double, char>, char>);
+
+    using Wide = decltype(make_wide(std::make_index_sequence<64>{}));
+    auto mv = Wide::builder()
+                  .capacity<wide_column<0>>(2)
+                  .capacity<63>(3)
+                  .default_value<wide_column<63>>(wide_column<63>{7})
+                  .build();
+    mv.push_back(wide_column<0>{1});
+    EXPECT_EQ(mv.size<wide_column<0>>(), 1u);
+    EXPECT_EQ(mv.data<0>()->value, 1);
+    EXPECT_EQ(mv.size<63>(), 3u);
+    EXPECT_EQ(mv.data<wide_column<63>>()[2].value, 7);
+    EXPECT_EQ(mv.capacity<wide_column<40>>(), 0u);
+}
+
+TEST(MultiVector, TrivialColumnsMoveBytewise) {
+    auto mv = multi_vector<int, double, std::string>::builder()
+                  .capacity<int>(8)
+                  .capacity<double>(4)
+                  .capacity<std::string>(4)
+                  .circular<double>()
+                  .build();
+    for (int i = 0; i < 5; ++i) mv.push_back<int>(i);
+    for (int i = 0; i < 6; ++i) mv.push_back<double>(i * 0.5);
+    mv.push_back<std::string>("kept");
+
+    auto snap = mv.snapshot();
+    mv.data<int>()[0] = 42;  // detaches the shared int column by copying it
+    EXPECT_EQ(snap.data<int>()[0], 0);
+    EXPECT_EQ(mv.data<int>()[4], 4);
+
+    mv.shrink_to_fit();
+    EXPECT_EQ(mv.capacity<int>(), 5u);
+    EXPECT_EQ((std::vector<int>(mv.begin<int>(), mv.end<int>())), (std::vector<int>{42, 1, 2, 3, 4}));
+    EXPECT_EQ((std::vector<double>(mv.begin<double>(), mv.end<double>())), (std::vector<double>{1.0, 1.5, 2.0, 2.5}));
+    EXPECT_EQ(mv.data<std::string>()[0], "kept");
+
+    auto moved = std::move(mv);
+    EXPECT_EQ(moved.size<int>(), 5u);
+    EXPECT_EQ(mv.size<int>(), 0u);
+    EXPECT_EQ(mv.capacity<double>(), 0u);
+}
+
+// Compiled once, whatever the schema
+static std::uint64_t trivial_column_checksum(column_descs cols) {
+    std::uint64_t h = 1469598103934665603ull;
+    for (column_desc c : cols) {
+        if (!c.trivially_copyable) continue;
+        const auto* bytes = static_cast<const unsigned char*>(c.data);
+        for (std::size_t j = 0; j < c.bytes(); ++j) h = (h ^ bytes[j]) * 1099511628211ull;
+    }
+    return h;
+}
+
+TEST(MultiVector, ColumnDescriptors) {
+    auto mv = multi_vector<std::uint16_t, double, std::string>::builder()
+                  .capacity<std::uint16_t>(4)
+                  .capacity<double>(3)
+                  .capacity<std::string>(2)
+                  .build();
+    mv.push_back<std::uint16_t>(7);
+    mv.push_back<std::uint16_t>(9);
+    mv.push_back<double>(1.5);
+    mv.push_back<std::string>("x");
+
+#if __cplusplus >= 202002L && defined(__cpp_lib_ranges)
+    static_assert(std::random_access_iterator<column_descs::iterator>);
+    static_assert(std::ranges::random_access_range<column_descs>);
+    static_assert(std::ranges::sized_range<column_descs>);
+#endif
+
+    const column_descs cols = mv.columns();
+    ASSERT_EQ(cols.size(), 3u);
+    EXPECT_EQ(cols.end() - cols.begin(), 3);
+    EXPECT_EQ((*(2 + cols.begin())).size, 1u);
+
+    const column_desc shorts = mv.column(0);
+    EXPECT_EQ(shorts.data, mv.data<std::uint16_t>());
+    EXPECT_EQ(shorts.element_size, sizeof(std::uint16_t));
+    EXPECT_EQ(shorts.alignment, alignof(std::uint16_t));
+    EXPECT_EQ(shorts.size, 2u);
+    EXPECT_EQ(shorts.capacity, 4u);
+    EXPECT_EQ(shorts.bytes(), 2 * sizeof(std::uint16_t));
+    EXPECT_TRUE(shorts.trivially_copyable);
+    EXPECT_TRUE(shorts.holds<std::uint16_t>());
+    EXPECT_FALSE(shorts.holds<std::int16_t>());
+    EXPECT_EQ(shorts.as<std::uint16_t>()[1], 9);
+
+    EXPECT_FALSE(mv.column(2).trivially_copyable);
+    EXPECT_EQ(mv.column(2).type, column_type_id_of<std::string>());
+    EXPECT_NE(mv.column(1).type, mv.column(2).type);
+    EXPECT_THROW(mv.column(3), std::out_of_range);
+
+    std::vector<std::size_t> sizes;
+    for (column_desc c : mv.columns()) sizes.push_back(c.size);
+    EXPECT_EQ(sizes, (std::vector<std::size_t>{2, 1, 1}));
+
+    // Same bytes under another schema give the same checksum
+    auto other = multi_vector<std::uint16_t, double>::builder().capacity<std::uint16_t>(2).capacity<double>(1).build();
+    other.push_back<std::uint16_t>(7);
+    other.push_back<std::uint16_t>(9);
+    other.push_back<double>(1.5);
+    EXPECT_EQ(trivial_column_checksum(mv.columns()), trivial_column_checksum(other.columns()));
+    mv.push_back<double>(2.5);
+    EXPECT_NE(trivial_column_checksum(mv.columns()), trivial_column_checksum(other.columns()));
+}
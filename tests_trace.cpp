@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// Counting trace hook, installed for every multi_vector in this file. It
+// lives in its own test binary so tests.cpp keeps the default null_hook.
+struct test_trace_hook {
+    static constexpr bool enabled = true;
+    static inline std::atomic<long> allocations{0};
+    static inline std::atomic<long> frees{0};
+    static inline std::atomic<long> live_bytes{0};
+    static inline std::atomic<long> builds{0};
+    static inline std::atomic<long> destroys{0};
+
+    static void allocated(const void*, std::size_t bytes) noexcept {
+        ++allocations;
+        live_bytes += static_cast<long>(bytes);
+    }
+    static void freed(const void*, std::size_t bytes) noexcept {
+        ++frees;
+        live_bytes -= static_cast<long>(bytes);
+    }
+    static void completed(const char* what, std::chrono::steady_clock::time_point start,
+                          std::chrono::steady_clock::time_point end, std::size_t) noexcept {
+        if (start > end) return;
+        if (std::string(what) == "multi_vector::build") ++builds;
+        if (std::string(what) == "multi_vector::destroy") ++destroys;
+    }
+};
+
+#define MULTI_VECTOR_TRACE_HOOK test_trace_hook
+#include "multi_vector.hpp"
+
+TEST(MultiVector, TraceHooks) {
+    const long allocations = test_trace_hook::allocations;
+    const long frees = test_trace_hook::frees;
+    const long builds = test_trace_hook::builds;
+    const long live = test_trace_hook::live_bytes;
+    {
+        auto mv = multi_vector<int, double>::builder().capacity<int>(8).capacity<double>(4).build();
+        EXPECT_EQ(test_trace_hook::allocations, allocations + 1);
+        EXPECT_EQ(test_trace_hook::builds, builds + 1);
+        EXPECT_GE(test_trace_hook::live_bytes, live + static_cast<long>(8 * sizeof(int) + 4 * sizeof(double)));
+
+        mv.push_back<int>(1);
+        auto snap = mv.snapshot();
+        mv.data<int>()[0] = 2;  // detaches a private copy of the int column
+        EXPECT_EQ(test_trace_hook::allocations, allocations + 2);
+    }
+    EXPECT_EQ(test_trace_hook::frees, frees + 2);
+    EXPECT_EQ(test_trace_hook::live_bytes, live);
+
+    // Only instances that still hold memory report their destruction
+    const long destroys = test_trace_hook::destroys;
+    {
+        multi_vector<int> empty;
+        auto mv = multi_vector<int>::builder().capacity<int>(4).build();
+        auto moved = std::move(mv);
+    }
+    EXPECT_EQ(test_trace_hook::destroys, destroys + 1);
+
+    const std::string path = ::testing::TempDir() + "multi_vector_trace.json";
+    ASSERT_TRUE(multi_vector_trace::chrome_trace::open(path.c_str()));
+    int block = 0;
+    const auto start = multi_vector_trace::clock::now();
+    multi_vector_trace::chrome_trace::allocated(&block, 64);
+    multi_vector_trace::chrome_trace::completed("multi_vector::build", start, multi_vector_trace::clock::now(), 64);
+    multi_vector_trace::chrome_trace::freed(&block, 64);
+    multi_vector_trace::chrome_trace::close();
+    multi_vector_trace::chrome_trace::freed(&block, 64);  // dropped once closed
+
+    std::ifstream in(path);
+    std::stringstream text;
+    text << in.rdbuf();
+    const std::string json = text.str();
+    EXPECT_EQ(json.front(), '[');
+    EXPECT_EQ(json.substr(json.size() - 2), "]\n");
+    EXPECT_NE(json.find("\"name\":\"allocate\""), std::string::npos);
+    EXPECT_NE(json.find("\"ph\":\"X\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"free\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"live bytes\""), std::string::npos);
+    std::remove(path.c_str());
+}